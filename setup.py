@@ -20,7 +20,7 @@ setup(
     url="https://github.com/tree-sitter/py-tree-sitter",
     license="MIT",
     platforms=["any"],
-    python_requires=">=3.3",
+    python_requires=">=3.7",
     description="Python bindings to the Tree-sitter parsing library",
     long_description=LONG_DESCRIPTION,
     long_description_content_type="text/markdown",
@@ -35,9 +35,14 @@ setup(
             "tree_sitter.binding",
             ["tree_sitter/core/lib/src/lib.c", "tree_sitter/binding.c"],
             include_dirs=["tree_sitter/core/lib/include", "tree_sitter/core/lib/src"],
+            # Route the core's allocations through the binding's accounting.
+            # tree-sitter's alloc.h declares the ts_record_* functions, which
+            # binding.c defines, when this is set.
+            define_macros=[("TREE_SITTER_ALLOCATION_TRACKING", "1")],
             extra_compile_args=(
                 ["-std=c99", "-Wno-unused-variable"] if system() != "Windows" else None
             ),
+            libraries=["dl"] if system() == "Linux" else None,
         )
     ],
     project_urls={"Source": "https://github.com/tree-sitter/py-tree-sitter"},
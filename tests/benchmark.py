@@ -0,0 +1,244 @@
+"""
+Benchmarks for the binding's hot paths, run with `script/bench`.
+
+The corpora are the example files and grammars of the fixture repositories
+fetched by `script/fetch-fixtures`, so results are comparable between runs.
+"""
+
+import argparse
+import json
+import sys
+import tracemalloc
+from concurrent.futures import ThreadPoolExecutor
+from glob import glob
+from os import path
+from statistics import median
+from time import perf_counter
+from tree_sitter import Language, Parser, ParserPool
+
+try:
+    import resource
+except ImportError:
+    resource = None
+
+FIXTURES_PATH = path.join("tests", "fixtures")
+LIB_PATH = path.join("build", "languages.so")
+
+CORPUS_GLOBS = {
+    "python": [
+        path.join(FIXTURES_PATH, "tree-sitter-python", "examples", "**", "*.py"),
+        path.join("tests", "*.py"),
+        path.join("tree_sitter", "*.py"),
+    ],
+    "javascript": [
+        path.join(FIXTURES_PATH, "tree-sitter-javascript", "examples", "**", "*.js"),
+        path.join(FIXTURES_PATH, "tree-sitter-*", "grammar.js"),
+    ],
+}
+
+QUERIES = {
+    "python": """
+        (function_definition name: (identifier) @function)
+        (call function: (identifier) @function.call)
+        ((identifier) @constant (#match? @constant "^[A-Z][A-Z_]*$"))
+        (string) @string
+        (comment) @comment
+    """,
+    "javascript": """
+        (function_declaration name: (identifier) @function)
+        (call_expression function: (identifier) @function.call)
+        ((identifier) @constant (#match? @constant "^[A-Z][A-Z_]*$"))
+        (string) @string
+        (comment) @comment
+    """,
+}
+
+
+def load_corpus(language_name):
+    paths = set()
+    for pattern in CORPUS_GLOBS[language_name]:
+        paths.update(glob(pattern, recursive=True))
+    sources = []
+    for source_path in sorted(paths):
+        with open(source_path, "rb") as f:
+            sources.append(f.read())
+    return sources
+
+
+def timed(function, min_time):
+    """Run `function` until `min_time` seconds have passed, returning the mean time."""
+    count = 0
+    start = end = perf_counter()
+    while count == 0 or end - start < min_time:
+        function()
+        count += 1
+        end = perf_counter()
+    return (end - start) / count
+
+
+def allocations(function):
+    """Return the peak Python memory used by one call of `function`, in KiB."""
+    tracemalloc.start()
+    try:
+        function()
+        _, peak = tracemalloc.get_traced_memory()
+    finally:
+        tracemalloc.stop()
+    return peak / 1024
+
+
+def walk_cursor(tree):
+    cursor = tree.walk()
+    count = 1
+    while True:
+        if cursor.goto_first_child() or cursor.goto_next_sibling():
+            count += 1
+            continue
+        while cursor.goto_parent():
+            if cursor.goto_next_sibling():
+                count += 1
+                break
+        else:
+            return count
+
+
+def walk_children(node):
+    count = 1
+    for child in node.children:
+        count += walk_children(child)
+    return count
+
+
+def point_for_offset(source, offset):
+    row = source.count(b"\n", 0, offset)
+    return (row, offset - (source.rfind(b"\n", 0, offset) + 1))
+
+
+def bench_language(language, sources, options):
+    results = {}
+    parser = Parser()
+    parser.set_language(language)
+    total_bytes = sum(len(source) for source in sources)
+    megabytes = total_bytes / 1e6
+
+    def parse_all():
+        return [parser.parse(source) for source in sources]
+
+    trees = parse_all()
+    results["parse_mb_per_sec"] = megabytes / timed(parse_all, options.min_time)
+    results["parse_peak_kib"] = allocations(parse_all)
+
+    # A single-byte insertion in the middle of the largest file
+    source = max(sources, key=len)
+    tree = parser.parse(source)
+    offset = len(source) // 2
+    point = point_for_offset(source, offset)
+    new_point = (point[0], point[1] + 1)
+    latencies = []
+    for _ in range(options.edits):
+        edited = tree.copy()
+        edited.edit(offset, offset, offset + 1, point, point, new_point, new_text=b" ")
+        start = perf_counter()
+        parser.parse(None, edited)
+        latencies.append(perf_counter() - start)
+    latencies.sort()
+    results["reparse_median_ms"] = median(latencies) * 1e3
+    results["reparse_p95_ms"] = latencies[int(len(latencies) * 0.95)] * 1e3
+
+    node_count = sum(walk_cursor(tree) for tree in trees)
+    results["nodes"] = node_count
+    for name, walk in [
+        ("cursor", lambda: [walk_cursor(tree) for tree in trees]),
+        ("children", lambda: [walk_children(tree.root_node) for tree in trees]),
+        ("descendants", lambda: [list(tree.root_node.descendants()) for tree in trees]),
+    ]:
+        results[name + "_nodes_per_sec"] = node_count / timed(walk, options.min_time)
+        results[name + "_peak_kib"] = allocations(walk)
+
+    results["text_mb_per_sec"] = megabytes / timed(
+        lambda: [tree.root_node.text for tree in trees], options.min_time
+    )
+
+    query = language.query(QUERIES[language.name])
+    capture_count = sum(len(query.captures(tree.root_node)) for tree in trees)
+    results["captures"] = capture_count
+    results["captures_per_sec"] = capture_count / timed(
+        lambda: [query.captures(tree.root_node) for tree in trees], options.min_time
+    )
+    results["captures_array_per_sec"] = capture_count / timed(
+        lambda: [query.captures_array(tree.root_node) for tree in trees], options.min_time
+    )
+    results["captures_peak_kib"] = allocations(
+        lambda: [query.captures(tree.root_node) for tree in trees]
+    )
+
+    pool = ParserPool()
+    for thread_count in options.threads:
+        with ThreadPoolExecutor(thread_count) as executor:
+
+            def parse_threaded():
+                list(executor.map(lambda source: pool.parse(language, source), sources))
+
+            results["parse_threads_%d_mb_per_sec" % thread_count] = megabytes / timed(
+                parse_threaded, options.min_time
+            )
+        results["parse_batch_%d_mb_per_sec" % thread_count] = megabytes / timed(
+            lambda: parser.parse_batch(sources, threads=thread_count), options.min_time
+        )
+    return results
+
+
+def main():
+    arguments = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    arguments.add_argument(
+        "--languages", default="python,javascript", help="comma-separated languages"
+    )
+    arguments.add_argument(
+        "--threads", default="1,2,4", help="comma-separated thread counts to scale to"
+    )
+    arguments.add_argument(
+        "--min-time", type=float, default=0.5, help="minimum seconds per benchmark"
+    )
+    arguments.add_argument(
+        "--edits", type=int, default=100, help="number of incremental reparses"
+    )
+    arguments.add_argument("--json", help="also write the results to this file")
+    options = arguments.parse_args()
+    options.threads = [int(count) for count in options.threads.split(",")]
+
+    Language.build_library(
+        LIB_PATH,
+        [
+            path.join(FIXTURES_PATH, "tree-sitter-python"),
+            path.join(FIXTURES_PATH, "tree-sitter-javascript"),
+        ],
+        flags=["-O2"],
+    )
+
+    results = {}
+    for language_name in options.languages.split(","):
+        sources = load_corpus(language_name)
+        if not sources:
+            sys.exit("No %s corpus; run script/fetch-fixtures first" % language_name)
+        language = Language(LIB_PATH, language_name)
+        results[language_name] = bench_language(language, sources, options)
+        total_bytes = sum(len(source) for source in sources)
+        print("%s (%d files, %d bytes)" % (language_name, len(sources), total_bytes))
+        for name, value in results[language_name].items():
+            print("  %-32s %14.2f" % (name, value))
+
+    if resource is not None:
+        # Kilobytes on Linux, bytes on macOS
+        peak_rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+        if sys.platform == "darwin":
+            peak_rss /= 1024
+        results["peak_rss_kib"] = peak_rss
+        print("peak_rss_kib %d" % peak_rss)
+
+    if options.json:
+        with open(options.json, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,9 +1,14 @@
 # pylint: disable=missing-docstring
 
+import copy
+import pickle
 import re
+from array import array
+from threading import Thread
 from unittest import TestCase
 from os import path
-from tree_sitter import Language, Parser
+from tree_sitter import Language, Parser, ParserPool, Point, QuerySet, Range, TreeCache
+from tree_sitter import allocated_bytes
 
 LIB_PATH = path.join("build", "languages.so")
 Language.build_library(
@@ -18,6 +23,17 @@ JAVASCRIPT = Language(LIB_PATH, "javascript")
 
 
 class TestParser(TestCase):
+    def test_language(self):
+        self.assertIsInstance(PYTHON.version, int)
+        self.assertEqual(Language(LIB_PATH, "python").language_id, PYTHON.language_id)
+        with self.assertRaises(AttributeError):
+            Language(LIB_PATH, "nonexistent")
+        with self.assertRaises(OSError):
+            Language(path.join("build", "nonexistent.so"), "python")
+        parser = Parser()
+        with self.assertRaises(TypeError):
+            parser.set_language(object())
+
     def test_set_language(self):
         parser = Parser()
         parser.set_language(PYTHON)
@@ -66,6 +82,310 @@ class TestParser(TestCase):
             "'🐍'",
         )
 
+    def test_parse_buffer(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        source = b"def foo():\n  bar()"
+        expected = parser.parse(source).root_node.sexp()
+
+        for buffer in [bytearray(source), memoryview(source)]:
+            tree = parser.parse(buffer)
+            self.assertEqual(tree.root_node.sexp(), expected)
+            self.assertEqual(tree.root_node.children[0].children[1].text, b"foo")
+
+        # Node text doesn't keep a mutable source from resizing
+        buffer = bytearray(source)
+        tree = parser.parse(buffer)
+        text = tree.root_node.children[0].children[1].text_view
+        buffer.extend(b"\n")
+        self.assertEqual(text, b"foo")
+
+        with self.assertRaises(TypeError):
+            parser.parse("def foo(): pass")
+
+    def test_parse_callback(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        source_lines = ["def foo():\n", "  bar()\n", "\n", "def baz():\n", "  quux()\n"]
+        expected = parser.parse("".join(source_lines).encode("utf8")).root_node.sexp()
+
+        def read_callback(byte_offset, point):
+            row, column = point
+            if row >= len(source_lines) or column >= len(source_lines[row]):
+                return None
+            return source_lines[row][column:].encode("utf8")
+
+        tree = parser.parse(read_callback)
+        self.assertEqual(tree.root_node.sexp(), expected)
+        self.assertEqual(tree.text, None)
+
+        def failing_callback(byte_offset, point):
+            raise KeyError("boom")
+
+        with self.assertRaises(KeyError):
+            parser.parse(failing_callback)
+        with self.assertRaises(TypeError):
+            parser.parse(lambda byte_offset, point: "not bytes")
+
+        # Parsing with the same parser from its own read callback raises
+        # rather than waiting for the parser forever
+        with self.assertRaises(RuntimeError):
+            parser.parse(lambda byte_offset, point: parser.parse(b"x").text)
+        self.assertEqual(parser.parse(read_callback).root_node.sexp(), expected)
+
+    def test_parse_timeout_and_cancellation(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        source = b"".join(
+            b"def f%d(a, b):\n  return [a, b, %d]\n" % (i, i) for i in range(5000)
+        )
+        expected = parser.parse(source).root_node.sexp()
+
+        self.assertEqual(parser.timeout_micros, 0)
+        parser.timeout_micros = 1
+        self.assertEqual(parser.timeout_micros, 1)
+        with self.assertRaises(TimeoutError):
+            parser.parse(source)
+
+        # Parsing the same input again resumes the halted parse
+        parser.timeout_micros = 0
+        self.assertEqual(parser.parse(source).root_node.sexp(), expected)
+
+        parser.cancel()
+        with self.assertRaises(RuntimeError):
+            parser.parse(source)
+        parser.reset()
+        self.assertEqual(
+            parser.parse(b"x").root_node.sexp(),
+            "(module (expression_statement (identifier)))",
+        )
+
+    def test_set_included_ranges(self):
+        source = b"<div>\nlet x = 1;\n</div>"
+        parser = Parser()
+        parser.set_language(JAVASCRIPT)
+        self.assertEqual(
+            parser.included_ranges,
+            [Range((0, 0), (2 ** 32 - 1, 2 ** 32 - 1), 0, 2 ** 32 - 1)],
+        )
+        parser.set_included_ranges([Range((1, 0), (1, 10), 6, 16)])
+        self.assertEqual(parser.included_ranges, [Range((1, 0), (1, 10), 6, 16)])
+        tree = parser.parse(source)
+        declaration = tree.root_node.children[0]
+        self.assertEqual(declaration.type, "lexical_declaration")
+        self.assertEqual(declaration.start_byte, 6)
+        self.assertEqual(declaration.children[1].children[0].start_point, (1, 4))
+        self.assertEqual(declaration.children[1].children[0].text, b"x")
+
+        # Captures can be used directly, and nested captures are merged
+        python_parser = Parser()
+        python_parser.set_language(PYTHON)
+        python_tree = python_parser.parse(b"a = 1\nb = 2\n")
+        query = PYTHON.query("(expression_statement) @statement (identifier) @name")
+        parser.set_included_ranges(query.captures(python_tree.root_node))
+        self.assertEqual(
+            parser.included_ranges,
+            [Range((0, 0), (0, 5), 0, 5), Range((1, 0), (1, 5), 6, 11)],
+        )
+
+        with self.assertRaises(TypeError):
+            parser.set_included_ranges([1])
+        parser.set_included_ranges([])
+        self.assertEqual(len(parser.included_ranges), 1)
+
+    def test_parser_pool(self):
+        pool = ParserPool(size=2)
+        with pool.parser(PYTHON) as parser1:
+            with pool.parser(PYTHON) as parser2:
+                self.assertIsNot(parser1, parser2)
+        with pool.parser(PYTHON) as parser3:
+            self.assertIn(parser3, (parser1, parser2))
+            with pool.parser(JAVASCRIPT) as parser4:
+                self.assertNotIn(parser4, (parser1, parser2))
+
+        # A parser is reset and returned to the pool after an exception
+        with self.assertRaises(ValueError):
+            with pool.parser(JAVASCRIPT) as parser5:
+                raise ValueError()
+        with pool.parser(JAVASCRIPT) as parser6:
+            self.assertIs(parser6, parser5)
+
+        # Settings made during a checkout don't leak into the next one
+        with pool.parser(JAVASCRIPT) as parser7:
+            parser7.set_included_ranges([Range((0, 0), (0, 2), 0, 2)])
+            parser7.timeout_micros = 1
+            parser7.enable_logging()
+            parser7.collect_stats = True
+        with pool.parser(JAVASCRIPT) as parser8:
+            self.assertIs(parser8, parser7)
+            self.assertEqual(len(parser8.included_ranges), 1)
+            self.assertEqual(parser8.included_ranges[0].end_byte, 2 ** 32 - 1)
+            self.assertEqual(parser8.timeout_micros, 0)
+            self.assertFalse(parser8.collect_stats)
+            parser8.parse(b"x;")
+            self.assertEqual(parser8.take_log(), [])
+
+        self.assertEqual(
+            pool.parse(JAVASCRIPT, b"x;").root_node.sexp(),
+            "(program (expression_statement (identifier)))",
+        )
+
+        results = []
+
+        def parse(language, source):
+            for _ in range(20):
+                results.append(pool.parse(language, source).root_node.type)
+
+        threads = [
+            Thread(target=parse, args=(PYTHON, b"x = 1")),
+            Thread(target=parse, args=(JAVASCRIPT, b"x = 1;")),
+            Thread(target=parse, args=(PYTHON, b"y = 2")),
+        ]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(sorted(set(results)), ["module", "program"])
+        self.assertEqual(len(results), 60)
+
+    def test_parse_stats(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        parser.parse(b"x = 1")
+        self.assertIsNone(parser.last_parse_stats)
+
+        parser.collect_stats = True
+        tree = parser.parse(b"def foo(:\n  bar()")
+        stats = parser.last_parse_stats
+        self.assertEqual(stats["bytes"], 19)
+        self.assertGreater(stats["node_count"], 5)
+        self.assertGreater(stats["error_count"], 0)
+        self.assertFalse(stats["incremental"])
+        self.assertGreaterEqual(stats["wall_time"], 0)
+
+        tree.edit(
+            start_byte=8,
+            old_end_byte=8,
+            new_end_byte=9,
+            start_point=(0, 8),
+            old_end_point=(0, 8),
+            new_end_point=(0, 9),
+        )
+        parser.parse(b"def foo():\n  bar()", tree)
+        stats = parser.last_parse_stats
+        self.assertEqual(stats["error_count"], 0)
+        self.assertTrue(stats["incremental"])
+
+    def test_logging(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        self.assertEqual(parser.take_log(), [])
+        parser.enable_logging()
+        parser.parse(b"x = 1")
+        log = parser.take_log()
+        self.assertTrue(log)
+        self.assertTrue(all(line.startswith(("lex: ", "parse: ")) for line in log))
+        self.assertEqual(parser.take_log(), [])
+
+        parser.enable_logging(sample=10)
+        parser.parse(b"x = 1")
+        self.assertLess(len(parser.take_log()), len(log))
+        parser.enable_logging(max_bytes=64)
+        parser.parse(b"x = 1")
+        self.assertLessEqual(sum(len(line) + 1 for line in parser.take_log()), 64)
+
+        parser.disable_logging()
+        parser.parse(b"x = 1")
+        self.assertEqual(parser.take_log(), [])
+
+    def test_tree_cache(self):
+        parser = Parser()
+        sizes = []
+        for language, source in [
+            (PYTHON, b"def foo():\n  bar()"),
+            (JAVASCRIPT, b"def foo():\n  bar()"),
+            (PYTHON, b"def foo(ab):\n  bar()"),
+        ]:
+            parser.set_language(language)
+            sizes.append(parser.parse(source).memory_usage()["total"])
+        cache = TreeCache(max_bytes=sizes[0] // 2 + sizes[1] + sizes[2])
+        tree1 = cache.parse(PYTHON, b"def foo():\n  bar()", path="a.py")
+        self.assertIs(cache.parse(PYTHON, "def foo():\n  bar()"), tree1)
+        self.assertIsNot(cache.parse(JAVASCRIPT, b"def foo():\n  bar()"), tree1)
+        self.assertEqual((cache.hits, cache.misses), (1, 2))
+
+        # A new version of a path is parsed incrementally from the old tree,
+        # which is left unchanged
+        tree2 = cache.parse(PYTHON, b"def foo(ab):\n  bar()", path="a.py")
+        parser = Parser()
+        parser.set_language(PYTHON)
+        self.assertEqual(
+            tree2.root_node.sexp(),
+            parser.parse(b"def foo(ab):\n  bar()").root_node.sexp(),
+        )
+        self.assertFalse(tree1.root_node.has_changes)
+        self.assertEqual(tree1.text, b"def foo():\n  bar()")
+
+        # The oldest trees are evicted once the trees exceed the budget
+        self.assertEqual(len(cache), 2)
+        self.assertIsNot(cache.parse(PYTHON, "def foo():\n  bar()"), tree1)
+        cache.clear()
+        self.assertEqual(len(cache), 0)
+
+        # A cached tree without its text, such as one edited in place, can't
+        # be diffed against, so the next version is parsed from scratch
+        cache = TreeCache()
+        cache.parse(PYTHON, b"def foo():\n  bar()", path="a.py").edit(
+            0, 0, 1, (0, 0), (0, 0), (0, 1)
+        )
+        tree3 = cache.parse(PYTHON, b"def foo(ab, c):\n  bar()", path="a.py")
+        self.assertEqual(
+            tree3.root_node.sexp(),
+            parser.parse(b"def foo(ab, c):\n  bar()").root_node.sexp(),
+        )
+
+    def test_parse_in_threads(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        sources = [b"def foo%d():\n  bar()" % i for i in range(8)]
+        trees = [None] * len(sources)
+
+        def parse(index):
+            trees[index] = parser.parse(sources[index])
+
+        threads = [Thread(target=parse, args=(i,)) for i in range(len(sources))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        for source, tree in zip(sources, trees):
+            self.assertEqual(tree.text, source)
+            self.assertEqual(tree.root_node.children[0].type, "function_definition")
+
+    def test_parse_batch(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        sources = [b"x = %d\n" % i * (i % 5 + 1) for i in range(20)]
+        sources.append(b"def foo():\n  bar()\n" * 200)
+
+        trees = parser.parse_batch(sources, threads=3)
+        self.assertEqual(len(trees), len(sources))
+        for source, tree in zip(sources, trees):
+            self.assertEqual(tree.text, source)
+            self.assertEqual(tree.root_node.end_byte, len(source))
+            self.assertEqual(tree.root_node.sexp(), parser.parse(source).root_node.sexp())
+
+        self.assertEqual(parser.parse_batch([]), [])
+        self.assertEqual(len(parser.parse_batch(sources[:2])), 2)
+        with self.assertRaises(TypeError):
+            parser.parse_batch([b"x = 1", "y = 2"])
+        with self.assertRaises(ValueError):
+            parser.parse_batch(sources, threads=0)
+
+        parser.set_language(JAVASCRIPT)
+        trees = parser.parse_batch([b"let a = 1;", b"let b = 2;"], threads=2)
+        self.assertEqual(trees[1].root_node.type, "program")
 
 class TestNode(TestCase):
     def test_child_by_field_id(self):
@@ -96,6 +416,17 @@ class TestNode(TestCase):
             fn_node.child_by_field_name("name"),
         )
 
+        js_parser = Parser()
+        js_parser.set_language(JAVASCRIPT)
+        js_tree = js_parser.parse(b"function foo() {}")
+        self.assertEqual(
+            js_tree.root_node.children[0].child_by_field_name("name").text, b"foo"
+        )
+        self.assertEqual(
+            parser.parse(source=b"def foo():\n  bar()", old_tree=None).root_node.sexp(),
+            root_node.sexp(),
+        )
+
     def test_children(self):
         parser = Parser()
         parser.set_language(PYTHON)
@@ -108,7 +439,12 @@ class TestNode(TestCase):
         self.assertEqual(root_node.start_point, (0, 0))
         self.assertEqual(root_node.end_point, (1, 7))
 
-        # List object is reused
+        self.assertEqual(root_node.end_point.row, 1)
+        self.assertEqual(root_node.end_point.column, 7)
+        self.assertIsInstance(root_node.end_point, Point)
+        self.assertIsInstance(root_node.end_point, tuple)
+
+        # Children sequence is reused
         self.assertIs(root_node.children, root_node.children)
 
         fn_node = root_node.children[0]
@@ -139,6 +475,38 @@ class TestNode(TestCase):
         self.assertEqual(statement_node.type, "block")
         self.assertEqual(statement_node.is_named, True)
 
+    def test_child_access(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo(a, b):\n  bar()")
+        fn_node = tree.root_node.children[0]
+        params_node = fn_node.child_by_field_name("parameters")
+
+        self.assertEqual(fn_node.child(1).type, "identifier")
+        self.assertIsNone(fn_node.child(5))
+        self.assertIsNone(fn_node.child(-1))
+        self.assertEqual(params_node.named_child(1).text, b"b")
+        self.assertIsNone(params_node.named_child(2))
+
+        children = params_node.children
+        self.assertEqual(len(children), 5)
+        self.assertEqual(children[-1].type, ")")
+        self.assertEqual(
+            [child.type for child in children[1:4]], ["identifier", ",", "identifier"]
+        )
+        self.assertEqual(children, [params_node.child(i) for i in range(5)])
+        self.assertEqual(list(children), [params_node.child(i) for i in range(5)])
+        with self.assertRaises(IndexError):
+            children[5]
+
+        named_children = params_node.named_children
+        self.assertIs(named_children, params_node.named_children)
+        self.assertEqual(len(named_children), 2)
+        self.assertEqual([child.text for child in named_children], [b"a", b"b"])
+        self.assertEqual(named_children[0], params_node.named_child(0))
+        self.assertEqual(len(params_node.child(0).children), 0)
+        self.assertEqual(list(params_node.child(0).named_children), [])
+
     def test_named_and_sibling_and_count_and_parent(self):
         parser = Parser()
         parser.set_language(PYTHON)
@@ -238,6 +606,34 @@ class TestNode(TestCase):
         self.assertEqual(list_node.child_count, 7)
         self.assertEqual(list_node.named_child_count, 3)
 
+    def test_descendant_for_range(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\n")
+        root_node = tree.root_node
+
+        self.assertEqual(root_node.descendant_for_byte_range(4, 7).text, b"foo")
+        self.assertEqual(root_node.descendant_for_byte_range(16, 17).type, "(")
+        self.assertEqual(
+            root_node.named_descendant_for_byte_range(16, 17).type, "argument_list"
+        )
+        self.assertEqual(
+            root_node.descendant_for_point_range((1, 2), (1, 5)).text, b"bar"
+        )
+        self.assertEqual(
+            root_node.named_descendant_for_point_range((1, 2), (1, 6)).type, "call"
+        )
+        with self.assertRaises(TypeError):
+            root_node.descendant_for_point_range([1, 2], [1, 5])
+
+        cursor = tree.walk()
+        self.assertEqual(cursor.goto_first_child_for_byte(12), 0)
+        self.assertEqual(cursor.node.type, "function_definition")
+        self.assertEqual(cursor.goto_first_child_for_byte(8), 2)
+        self.assertEqual(cursor.node.type, "parameters")
+        self.assertIsNone(cursor.goto_first_child_for_byte(100))
+        self.assertEqual(cursor.node.type, "parameters")
+
     def test_node_text(self):
         parser = Parser()
         parser.set_language(PYTHON)
@@ -269,6 +665,12 @@ class TestNode(TestCase):
         close_delim_node = list_node.children[4]
         self.assertEqual(close_delim_node.text, b']')
 
+        self.assertIsInstance(child_list_node.text_bytes, bytes)
+        self.assertEqual(child_list_node.text_bytes, b'[1, 2, 3]')
+        self.assertIsInstance(child_list_node.text_view, memoryview)
+        self.assertEqual(child_list_node.text_view, b'[1, 2, 3]')
+        self.assertEqual(child_list_node.text_view.obj, tree.text)
+
         edit_offset = len(b"[0, [")
         tree.edit(
             start_byte=edit_offset,
@@ -282,6 +684,32 @@ class TestNode(TestCase):
 
         root_node_again = tree.root_node
         self.assertEqual(root_node_again.text, None)
+        self.assertEqual(root_node_again.text_bytes, None)
+        self.assertEqual(root_node_again.text_view, None)
+
+    def test_intern_nodes(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()")
+        self.assertFalse(tree.intern_nodes)
+        self.assertIsNot(tree.root_node, tree.root_node)
+        self.assertEqual(tree.root_node, tree.root_node)
+
+        tree.intern_nodes = True
+        self.assertTrue(tree.intern_nodes)
+        root_node = tree.root_node
+        self.assertIs(tree.root_node, root_node)
+        fn_node = root_node.children[0]
+        self.assertIs(fn_node.parent, root_node)
+        self.assertIs(fn_node.child_by_field_name("name"), fn_node.children[1])
+        self.assertIs(fn_node.children[1].next_sibling, fn_node.children[2])
+
+        # Interned nodes are dropped from the cache once unreferenced
+        del root_node, fn_node
+        self.assertEqual(tree.root_node.children[0].children[1].type, "identifier")
+
+        tree.intern_nodes = False
+        self.assertIsNot(tree.root_node, tree.root_node)
 
     def test_tree(self):
         code = b"def foo():\n  bar()\n\ndef foo():\n  bar()"
@@ -365,6 +793,112 @@ class TestTree(TestCase):
         self.assertEqual(cursor.node.is_named, True)
         self.assertEqual(cursor.current_field_name(), "parameters")
 
+    def test_walk_preorder_and_postorder(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\n\nx = [1, 2]\n")
+
+        def preorder(node):
+            yield node
+            for child in node.children:
+                yield from preorder(child)
+
+        def postorder(node):
+            for child in node.children:
+                yield from postorder(child)
+            yield node
+
+        self.assertEqual(list(tree.walk_preorder()), list(preorder(tree.root_node)))
+        self.assertEqual(list(tree.walk_postorder()), list(postorder(tree.root_node)))
+
+        fn_node = tree.root_node.children[0]
+        self.assertEqual(
+            list(fn_node.descendants(order="postorder")),
+            list(postorder(fn_node)),
+        )
+        self.assertEqual(
+            list(tree.walk_preorder(named_only=True)),
+            [node for node in preorder(tree.root_node) if node.is_named],
+        )
+        self.assertEqual(
+            [node.text for node in tree.walk_preorder(types={"identifier", "integer"})],
+            [b"foo", b"bar", b"x", b"1", b"2"],
+        )
+        self.assertEqual(
+            [
+                node.text
+                for node in tree.walk_preorder(types=["identifier"], start_byte=20)
+            ],
+            [b"x"],
+        )
+
+        info = list(tree.walk_preorder(with_info=True))
+        self.assertEqual(info[0], (tree.root_node, 0, None))
+        self.assertEqual(info[2][0].type, "def")
+        self.assertEqual(info[3][0].type, "identifier")
+        self.assertEqual(info[3][1:], (2, "name"))
+
+        with self.assertRaises(ValueError):
+            tree.root_node.descendants(order="inorder")
+
+    def test_to_arrays(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\n\nx = [1, 2]\n")
+
+        for named_only in (False, True):
+            nodes = list(tree.walk_preorder(named_only=named_only))
+            arrays = tree.to_arrays(named_only=named_only)
+            self.assertEqual(len(arrays["symbol"]), len(nodes))
+            self.assertEqual(list(arrays["symbol"]), [node.symbol for node in nodes])
+            self.assertEqual(
+                list(arrays["start_byte"]), [node.start_byte for node in nodes]
+            )
+            self.assertEqual(list(arrays["end_byte"]), [node.end_byte for node in nodes])
+            self.assertEqual(arrays["parent"][0], -1)
+            self.assertEqual(arrays["depth"][0], 0)
+            for i in range(1, len(nodes)):
+                parent = arrays["parent"][i]
+                self.assertLess(parent, i)
+                self.assertEqual(arrays["depth"][i], arrays["depth"][parent] + 1)
+                self.assertLessEqual(nodes[parent].start_byte, nodes[i].start_byte)
+                self.assertGreaterEqual(nodes[parent].end_byte, nodes[i].end_byte)
+
+        arrays = tree.to_arrays()
+        nodes = list(tree.walk_preorder())
+        self.assertEqual(nodes[3].type, "identifier")
+        self.assertEqual(arrays["parent"][3], 1)
+        self.assertEqual(arrays["field_id"][3], PYTHON.field_id_for_name("name"))
+        self.assertEqual(arrays["field_id"][0], 0)
+
+    def test_pickle(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\n")
+        loaded = pickle.loads(pickle.dumps(tree))
+        self.assertEqual(loaded.text, tree.text)
+        self.assertEqual(loaded.root_node.sexp(), tree.root_node.sexp())
+
+        tree.edit(
+            start_byte=6,
+            old_end_byte=7,
+            new_end_byte=7,
+            start_point=(0, 6),
+            old_end_point=(0, 7),
+            new_end_point=(0, 7),
+        )
+        with self.assertRaises(pickle.PicklingError):
+            pickle.dumps(tree)
+
+        # Trees parsed over included ranges are parsed over the same ranges
+        # when loaded
+        parser.set_language(JAVASCRIPT)
+        parser.set_included_ranges([Range((1, 0), (1, 10), 6, 16)])
+        tree = parser.parse(b"<div>\nlet x = 1;\n</div>")
+        loaded = pickle.loads(pickle.dumps(tree))
+        self.assertEqual(loaded.included_ranges, [Range((1, 0), (1, 10), 6, 16)])
+        self.assertEqual(loaded.root_node.sexp(), tree.root_node.sexp())
+
     def test_edit(self):
         parser = Parser()
         parser.set_language(PYTHON)
@@ -407,6 +941,278 @@ class TestTree(TestCase):
             ),
         )
 
+    def test_close(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()")
+        node = tree.root_node.children[0]
+        children = node.children
+        cursor = tree.walk()
+        query = PYTHON.query("(identifier) @name")
+        self.assertFalse(tree.closed)
+
+        tree.close()
+        self.assertTrue(tree.closed)
+        self.assertEqual(tree.memory_usage()["tree"], 0)
+        with self.assertRaisesRegex(ValueError, "Tree is closed"):
+            tree.root_node
+        with self.assertRaises(ValueError):
+            node.type
+        with self.assertRaises(ValueError):
+            len(children)
+        with self.assertRaises(ValueError):
+            list(children)
+        with self.assertRaises(ValueError):
+            cursor.node
+        with self.assertRaises(ValueError):
+            query.captures(node)
+        with self.assertRaises(ValueError):
+            tree.copy()
+        with self.assertRaises(ValueError):
+            parser.parse(b"def foo():\n  bar()", tree)
+        self.assertEqual(node, node)
+        self.assertIn("closed", repr(node))
+        tree.close()
+
+        # A tree can't be closed while a parse uses it as its old tree
+        tree = parser.parse(b"x = 1")
+
+        def read_callback(byte_offset, point):
+            tree.close()
+
+        with self.assertRaisesRegex(RuntimeError, "in use"):
+            parser.parse(read_callback, tree)
+        self.assertFalse(tree.closed)
+
+        with parser.parse(b"x = 1") as tree:
+            self.assertEqual(tree.root_node.type, "module")
+        self.assertTrue(tree.closed)
+
+    def test_memory_usage(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        before = allocated_bytes()
+        tree = parser.parse(b"def foo():\n  bar()\n" * 100)
+        self.assertGreater(allocated_bytes(), before)
+        usage = tree.memory_usage()
+        self.assertGreater(usage["tree"], 0)
+        self.assertEqual(usage["source"], 2000)
+        self.assertGreaterEqual(usage["wrappers"], tree.__sizeof__())
+        self.assertEqual(
+            usage["total"], usage["tree"] + usage["source"] + usage["wrappers"]
+        )
+        during = allocated_bytes()
+        tree.close()
+        self.assertLess(allocated_bytes(), during)
+
+        # Sources are measured in bytes, not items
+        source = array("H", b"x = 1\n" * 100)
+        self.assertEqual(parser.parse(source).memory_usage()["source"], 600)
+
+    def test_allocated_bytes(self):
+        # The core's allocations must reach the binding's accounting, or these
+        # would all stay at zero
+        parser = Parser()
+        parser.set_language(PYTHON)
+        before = allocated_bytes()
+        tree = parser.parse(b"def foo():\n  bar()\n")
+        self.assertGreater(allocated_bytes(), before)
+        self.assertGreater(tree.memory_usage()["tree"], 0)
+
+        # Memory returned by the core is freed with the matching allocator
+        self.assertTrue(tree.root_node.sexp().startswith("(module"))
+        self.assertEqual(tree.changed_ranges(tree.copy()), [])
+
+    def test_cache_children(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()")
+        node = tree.root_node
+        self.assertTrue(tree.cache_children)
+        self.assertIs(node.children, node.children)
+        tree.cache_children = False
+        self.assertIsNot(node.children, node.children)
+        self.assertEqual(node.children, node.children)
+        self.assertFalse(tree.copy().cache_children)
+
+    def test_copy(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()")
+        tree_copy = tree.copy()
+        self.assertEqual(tree_copy.root_node.sexp(), tree.root_node.sexp())
+        self.assertEqual(tree_copy.text, tree.text)
+
+        edit_offset = len(b"def foo(")
+        tree_copy.edit(
+            start_byte=edit_offset,
+            old_end_byte=edit_offset,
+            new_end_byte=edit_offset + 2,
+            start_point=(0, edit_offset),
+            old_end_point=(0, edit_offset),
+            new_end_point=(0, edit_offset + 2),
+            new_text=b"ab",
+        )
+        self.assertTrue(tree_copy.root_node.has_changes)
+        self.assertFalse(tree.root_node.has_changes)
+        self.assertEqual(tree.text, b"def foo():\n  bar()")
+
+        # Copies of edited trees get their own text
+        second_copy = copy.copy(tree_copy)
+        second_copy.edit(
+            start_byte=0,
+            old_end_byte=3,
+            new_end_byte=5,
+            start_point=(0, 0),
+            old_end_point=(0, 3),
+            new_end_point=(0, 5),
+            new_text=b"async",
+        )
+        self.assertEqual(tree_copy.text, b"def foo(ab):\n  bar()")
+        self.assertEqual(second_copy.text, b"async foo(ab):\n  bar()")
+        self.assertEqual(
+            parser.parse(None, second_copy).root_node.sexp(),
+            parser.parse(b"async foo(ab):\n  bar()").root_node.sexp(),
+        )
+
+    def test_edit_during_parse(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"x = 1\n")
+
+        def read_callback(byte_offset, point):
+            tree.edit(
+                start_byte=0,
+                old_end_byte=1,
+                new_end_byte=1,
+                start_point=(0, 0),
+                old_end_point=(0, 1),
+                new_end_point=(0, 1),
+            )
+
+        # A tree can't be edited while a parse uses it as its old tree
+        with self.assertRaisesRegex(RuntimeError, "in use"):
+            parser.parse(read_callback, tree)
+        self.assertEqual(tree.text, b"x = 1\n")
+
+    def test_edit_with_new_text(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()")
+
+        edit_offset = len(b"def foo(")
+        tree.edit(
+            start_byte=edit_offset,
+            old_end_byte=edit_offset,
+            new_end_byte=edit_offset + 2,
+            start_point=(0, edit_offset),
+            old_end_point=(0, edit_offset),
+            new_end_point=(0, edit_offset + 2),
+            new_text=b"ab",
+        )
+        self.assertEqual(tree.text, b"def foo(ab):\n  bar()")
+        self.assertEqual(tree.root_node.children[0].children[2].text, b"(ab)")
+
+        tree.edit(
+            start_byte=0,
+            old_end_byte=3,
+            new_end_byte=5,
+            start_point=(0, 0),
+            old_end_point=(0, 3),
+            new_end_point=(0, 5),
+            new_text=b"async",
+        )
+        self.assertEqual(tree.text, b"async foo(ab):\n  bar()")
+
+        with self.assertRaises(ValueError):
+            tree.edit(
+                start_byte=0,
+                old_end_byte=0,
+                new_end_byte=2,
+                start_point=(0, 0),
+                old_end_point=(0, 0),
+                new_end_point=(0, 2),
+                new_text=b"x",
+            )
+
+        tree.edit(
+            start_byte=0,
+            old_end_byte=6,
+            new_end_byte=0,
+            start_point=(0, 0),
+            old_end_point=(0, 6),
+            new_end_point=(0, 0),
+            new_text=b"",
+        )
+        old_node = tree.root_node.children[0]
+        new_tree = parser.parse(None, tree)
+        self.assertEqual(new_tree.text, b"foo(ab):\n  bar()")
+        self.assertEqual(
+            new_tree.root_node.sexp(),
+            parser.parse(b"foo(ab):\n  bar()").root_node.sexp(),
+        )
+        # The text moved to the new tree, so the old tree and its nodes have none
+        self.assertEqual(tree.text, None)
+        self.assertEqual(old_node.text, None)
+        with self.assertRaises(ValueError):
+            parser.parse(None, tree)
+
+        # Predicates read the text on both sides of the edit, including a
+        # node that spans it
+        tree = parser.parse(b"fo = foo\n")
+        tree.edit(
+            start_byte=1,
+            old_end_byte=1,
+            new_end_byte=2,
+            start_point=(0, 1),
+            old_end_point=(0, 1),
+            new_end_point=(0, 2),
+            new_text=b"o",
+        )
+        new_tree = parser.parse(None, tree)
+        query = PYTHON.query(
+            '((assignment left: (identifier) @left right: (identifier) @right)'
+            ' (#eq? @left @right) (#eq? @right "foo"))'
+        )
+        self.assertEqual(
+            [node.text for node, _ in query.captures(new_tree.root_node)],
+            [b"foo", b"foo"],
+        )
+
+    def test_changed_ranges(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\n\ndef baz():\n  quux()\n")
+
+        edit_offset = len(b"def foo():\n  bar(")
+        tree.edit(
+            start_byte=edit_offset,
+            old_end_byte=edit_offset,
+            new_end_byte=edit_offset + 1,
+            start_point=(1, 6),
+            old_end_point=(1, 6),
+            new_end_point=(1, 7),
+            new_text=b"x",
+        )
+        new_tree = parser.parse(None, tree)
+        changed_ranges = tree.changed_ranges(new_tree)
+        self.assertEqual(len(changed_ranges), 1)
+        self.assertLessEqual(changed_ranges[0].start_byte, edit_offset)
+        self.assertGreaterEqual(changed_ranges[0].end_byte, edit_offset + 1)
+        self.assertEqual(changed_ranges[0].start_point[0], 1)
+        self.assertEqual(changed_ranges[0].end_point[0], 1)
+
+        changed_range = changed_ranges[0]
+        self.assertEqual(
+            changed_range,
+            Range(
+                changed_range.start_point,
+                changed_range.end_point,
+                changed_range.start_byte,
+                changed_range.end_byte,
+            ),
+        )
+        self.assertEqual(new_tree.changed_ranges(new_tree), [])
 
 class TestQuery(TestCase):
     def test_errors(self):
@@ -420,6 +1226,38 @@ class TestQuery(TestCase):
             PYTHON.query("(list))")
         PYTHON.query("(function_definition)")
 
+    def test_query_set(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        source = b"def foo():\n  bar()\ndef baz():\n  quux()\n"
+        tree = parser.parse(source)
+        definitions = PYTHON.query("(function_definition name: (identifier) @name)")
+        calls = """
+            (call function: (identifier) @name)
+            ((identifier) @short (#match? @short "^...$"))
+        """
+        query_set = PYTHON.query_set([definitions, calls])
+        self.assertEqual(query_set.query_count, 2)
+        self.assertEqual(query_set.query.pattern_count, 3)
+
+        self.assertEqual(
+            query_set.captures(tree.root_node),
+            [
+                definitions.captures(tree.root_node),
+                PYTHON.query(calls).captures(tree.root_node),
+            ],
+        )
+        def_matches, call_matches = query_set.matches(tree.root_node)
+        self.assertEqual([m[0] for m in def_matches], [0, 0])
+        self.assertEqual(
+            sorted(
+                (m[0], m[1]["name" if m[0] == 0 else "short"].text) for m in call_matches
+            ),
+            [(0, b"bar"), (0, b"quux"), (1, b"bar"), (1, b"baz"), (1, b"foo")],
+        )
+        with self.assertRaises(ValueError):
+            QuerySet(definitions, [2])
+
     def test_captures(self):
         parser = Parser()
         parser.set_language(PYTHON)
@@ -445,6 +1283,14 @@ class TestQuery(TestCase):
         self.assertEqual(captures[1][0].end_point, (1, 5))
         self.assertEqual(captures[1][1], "func-call")
 
+        self.assertEqual(query.captures(node=tree.root_node, start_byte=0), captures)
+        with self.assertRaises(TypeError):
+            query.captures(tree.root_node, node=tree.root_node)
+        with self.assertRaises(TypeError):
+            query.captures(tree.root_node, start=0)
+        with self.assertRaises(TypeError):
+            query.captures()
+
         self.assertEqual(captures[2][0].start_point, (2, 4))
         self.assertEqual(captures[2][0].end_point, (2, 7))
         self.assertEqual(captures[2][1], "func-def")
@@ -453,6 +1299,270 @@ class TestQuery(TestCase):
         self.assertEqual(captures[3][0].end_point, (3, 6))
         self.assertEqual(captures[3][1], "func-call")
 
+    def test_captures_in_ranges(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        source = b"def foo():\n  bar()\ndef baz():\n  quux()\n"
+        tree = parser.parse(source)
+        query = PYTHON.query("(call function: (identifier) @func-call)")
+
+        second_line = Range((1, 0), (2, 0), 11, 19)
+        fourth_line = Range((3, 0), (4, 0), 30, 39)
+        captures = query.captures(
+            tree.root_node, ranges=[fourth_line, second_line, second_line]
+        )
+        self.assertEqual([node.text for node, _ in captures], [b"bar", b"quux"])
+        self.assertEqual(query.captures(tree.root_node, ranges=[]), [])
+        self.assertEqual(len(query.captures(tree.root_node)), 2)
+        with self.assertRaises(TypeError):
+            query.captures(tree.root_node, ranges=[(11, 19)])
+
+        # An empty range contains nothing, even at the start of the document
+        empty = Range((0, 0), (0, 0), 0, 0)
+        self.assertEqual(query.captures(tree.root_node, ranges=[empty]), [])
+        self.assertEqual(query.captures(tree.root_node, start_byte=0, end_byte=0), [])
+        self.assertEqual(query.matches(tree.root_node, start_byte=0, end_byte=0), [])
+        self.assertEqual(
+            list(query.iter_captures(tree.root_node, start_byte=0, end_byte=0)), []
+        )
+        self.assertEqual(
+            len(query.captures(tree.root_node, ranges=[empty, second_line])), 1
+        )
+
+        # Only the repeats caused by overlapping ranges are dropped, not two
+        # patterns capturing the same node
+        query = PYTHON.query(
+            """
+            (call function: (identifier) @func-call)
+            ((identifier) @func-call (#eq? @func-call "bar"))
+            """
+        )
+        self.assertEqual(len(query.captures(tree.root_node, ranges=[second_line])), 2)
+        captures = query.captures(
+            tree.root_node, ranges=[second_line, Range((1, 0), (1, 5), 11, 16)]
+        )
+        self.assertEqual([node.text for node, _ in captures], [b"bar", b"bar"])
+
+        # A node that extends across separate ranges is captured from each
+        query = PYTHON.query("(function_definition) @func-def")
+        first_line = Range((0, 0), (0, 4), 0, 4)
+        body = Range((1, 2), (1, 5), 13, 16)
+        captures = query.captures(tree.root_node, ranges=[first_line, body])
+        self.assertEqual([node.text[:7] for node, _ in captures], [b"def foo"] * 2)
+        overlapping = Range((0, 2), (1, 5), 2, 16)
+        captures = query.captures(tree.root_node, ranges=[first_line, overlapping])
+        self.assertEqual(len(captures), 1)
+
+    def test_matches(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        source = b"def foo(a, b):\n  bar()\ndef baz():\n  quux()\n"
+        tree = parser.parse(source)
+        query = PYTHON.query(
+            """
+            (function_definition name: (identifier) @func-def
+              parameters: (parameters (identifier)* @param))
+            (call function: (identifier) @func-call)
+            """
+        )
+
+        matches = query.matches(tree.root_node)
+        self.assertEqual(len(matches), 4)
+        self.assertEqual(matches[0][0], 0)
+        self.assertEqual(matches[0][1]["func-def"].text, b"foo")
+        self.assertEqual([node.text for node in matches[0][1]["param"]], [b"a", b"b"])
+        self.assertEqual(matches[1][0], 1)
+        self.assertEqual(matches[1][1]["func-call"].text, b"bar")
+        self.assertEqual(matches[2][1]["func-def"].text, b"baz")
+        self.assertNotIn("param", matches[2][1])
+
+        iterated = list(query.iter_matches(tree.root_node))
+        self.assertEqual([pattern for pattern, _ in iterated], [0, 1, 0, 1])
+        self.assertEqual(iterated[3][1]["func-call"], matches[3][1]["func-call"])
+        with self.assertRaises(TypeError):
+            query.matches(tree)
+
+    def test_iter_captures(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\ndef baz():\n  quux()\n")
+        query = PYTHON.query("(call function: (identifier) @func-call)")
+
+        captures = query.iter_captures(tree.root_node)
+        self.assertIs(iter(captures), captures)
+        node, name = next(captures)
+        self.assertEqual((node.text, name), (b"bar", "func-call"))
+        # Other calls can run while an iterator is still in progress
+        self.assertEqual(len(query.captures(tree.root_node)), 2)
+        node, name = next(captures)
+        self.assertEqual(node.text, b"quux")
+        self.assertRaises(StopIteration, next, captures)
+        self.assertRaises(StopIteration, next, captures)
+
+    def test_captures_in_point_and_byte_range(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\ndef baz():\n  quux()\n")
+        query = PYTHON.query("(call function: (identifier) @func-call)")
+
+        captures = query.captures(tree.root_node, start_point=(2, 0), end_point=(4, 0))
+        self.assertEqual([node.text for node, _ in captures], [b"quux"])
+        captures = query.captures(tree.root_node, start_byte=0, end_byte=19)
+        self.assertEqual([node.text for node, _ in captures], [b"bar"])
+        matches = query.matches(tree.root_node, start_point=(1, 0), end_point=(2, 0))
+        self.assertEqual(len(matches), 1)
+        captures = list(query.iter_captures(tree.root_node, start_byte=30))
+        self.assertEqual([node.text for node, _ in captures], [b"quux"])
+
+        # Restrictions don't leak into the next call
+        self.assertEqual(len(query.captures(tree.root_node)), 2)
+        with self.assertRaises(TypeError):
+            query.captures(tree.root_node, start_point=[0, 0])
+
+    def test_pickle(self):
+        source = "(function_definition name: (identifier) @func-def)"
+        query = PYTHON.query(source)
+        self.assertIs(PYTHON.query(source), query)
+        self.assertEqual(query.source, source.encode("utf8"))
+
+        loaded = pickle.loads(pickle.dumps(query))
+        self.assertIs(loaded, query)
+        self.assertIs(pickle.loads(pickle.dumps(PYTHON)), PYTHON)
+
+    def test_query_cache(self):
+        language = Language(LIB_PATH, "python")
+        language.query_cache_size = 2
+        query1 = language.query("(identifier) @a")
+        query2 = language.query("(integer) @b")
+        self.assertIs(language.query("(identifier) @a"), query1)
+        language.query("(string) @c")
+        self.assertIs(language.query(b"(identifier) @a"), query1)
+        self.assertIsNot(language.query("(integer) @b"), query2)
+
+    def test_match_limit(self):
+        query = PYTHON.query("(call function: (identifier) @func-call)")
+        self.assertEqual(query.match_limit, 2 ** 32 - 1)
+        query.match_limit = 32
+        self.assertEqual(query.match_limit, 32)
+        with self.assertRaises(ValueError):
+            query.match_limit = 0
+
+    def test_stats(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"foo()\nbar()\nfoo()\n")
+        query = PYTHON.query(
+            '((call function: (identifier) @name) (#eq? @name "foo") @call)'
+        )
+        query.reset_stats()
+        self.assertEqual(len(query.captures(tree.root_node)), 4)
+        self.assertEqual(len(query.matches(tree.root_node)), 2)
+        self.assertFalse(query.did_exceed_match_limit)
+        self.assertEqual(query.stats["executions"], 2)
+        self.assertEqual(query.stats["captures_emitted"], 8)
+        self.assertEqual(query.stats["match_limit_exceeded"], 0)
+        # Each match is examined once, however many captures it has
+        self.assertEqual(query.stats["matches_examined"], 6)
+        query.reset_stats()
+        self.assertEqual(query.stats["executions"], 0)
+
+    def test_predicates(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        source = b"def foo():\n  bar()\n  foo()\ndef baz():\n  quux()\n  baz()\n"
+        tree = parser.parse(source)
+
+        def texts(query_source):
+            query = PYTHON.query(query_source)
+            return [node.text for node, _ in query.captures(tree.root_node)]
+
+        self.assertEqual(
+            texts('((call function: (identifier) @call) (#eq? @call "bar"))'),
+            [b"bar"],
+        )
+        self.assertEqual(
+            texts('((call function: (identifier) @call) (#not-eq? @call "bar"))'),
+            [b"foo", b"quux", b"baz"],
+        )
+        self.assertEqual(
+            texts('((call function: (identifier) @call) (#match? @call "^[bq]u"))'),
+            [b"quux"],
+        )
+        self.assertEqual(
+            texts(
+                '((call function: (identifier) @call) (#any-of? @call "foo" "quux" "x"))'
+            ),
+            [b"foo", b"quux"],
+        )
+        self.assertEqual(
+            texts(
+                '((call function: (identifier) @call) (#not-any-of? @call "foo" "quux"))'
+            ),
+            [b"bar", b"baz"],
+        )
+
+        query = PYTHON.query(
+            """
+            ((function_definition
+              name: (identifier) @name
+              body: (block (expression_statement (call function: (identifier) @call))))
+             (#eq? @name @call))
+            """
+        )
+        matches = query.matches(tree.root_node)
+        self.assertEqual([m[1]["call"].text for m in matches], [b"foo", b"baz"])
+        self.assertEqual(len(list(query.iter_matches(tree.root_node))), 2)
+        self.assertEqual(len(list(query.iter_captures(tree.root_node))), 4)
+
+        with self.assertRaises(SyntaxError):
+            PYTHON.query('((identifier) @id (#eq? @id "a" "b"))')
+        with self.assertRaises(SyntaxError):
+            PYTHON.query('((identifier) @id (#match? "a" @id))')
+
+        # Without the tree's text, predicates raise instead of being skipped
+        callback_tree = parser.parse(lambda byte_offset, point: source[byte_offset:])
+        self.assertEqual(callback_tree.text, None)
+        with self.assertRaises(ValueError):
+            query.matches(callback_tree.root_node)
+        with self.assertRaises(ValueError):
+            list(query.iter_captures(callback_tree.root_node))
+        self.assertEqual(
+            len(PYTHON.query("(call) @call").captures(callback_tree.root_node)), 4
+        )
+
+    def test_captures_array(self):
+        parser = Parser()
+        parser.set_language(PYTHON)
+        tree = parser.parse(b"def foo():\n  bar()\ndef baz():\n  quux()\n")
+        query = PYTHON.query(
+            """
+            (function_definition name: (identifier) @func-def)
+            (call function: (identifier) @func-call)
+            """
+        )
+        captures = query.captures(tree.root_node)
+        arrays = query.captures_array(tree.root_node)
+
+        self.assertEqual(len(arrays), len(captures))
+        self.assertEqual(arrays.capture_names, ["func-def", "func-call"])
+        self.assertEqual(arrays.start_byte.format, "I")
+        self.assertEqual(arrays.symbol.format, "H")
+        for i, (node, name) in enumerate(captures):
+            self.assertEqual(arrays.capture_names[arrays.capture_index[i]], name)
+            self.assertEqual(arrays.start_byte[i], node.start_byte)
+            self.assertEqual(arrays.end_byte[i], node.end_byte)
+            self.assertEqual(
+                (arrays.start_row[i], arrays.start_column[i]), node.start_point
+            )
+            self.assertEqual((arrays.end_row[i], arrays.end_column[i]), node.end_point)
+            self.assertEqual(arrays.node(i), node)
+        self.assertEqual(len(set(arrays.symbol.tolist())), 1)
+        self.assertEqual(arrays.node(-1), captures[-1][0])
+        self.assertRaises(IndexError, arrays.node, len(captures))
+
+        empty = query.captures_array(tree.root_node, start_byte=0, end_byte=0)
+        self.assertEqual(len(empty), 0)
+        self.assertEqual(empty.start_byte.tolist(), [])
 
 def trim(string):
     return re.sub(r"\s+", " ", string).strip()
@@ -1,30 +1,52 @@
 """Python bindings for tree-sitter."""
 
-from ctypes import cdll, c_void_p
-from ctypes.util import find_library
+import copyreg
+from collections import OrderedDict, deque
+from contextlib import contextmanager
+from concurrent.futures import ThreadPoolExecutor
 from distutils.ccompiler import new_compiler
-from os import path
+from hashlib import sha256
+from os import cpu_count, makedirs, path, replace, walk
+from pickle import PicklingError
 from platform import system
 from tempfile import TemporaryDirectory
+from threading import Lock
 from tree_sitter.binding import _language_field_id_for_name, _language_query
-from tree_sitter.binding import Node, Parser, Tree, TreeCursor  # noqa: F401
+from tree_sitter.binding import _query_language_id, _source_edit, _tree_language_id
+from tree_sitter.binding import Language as _Language, allocated_bytes  # noqa: F401
+from tree_sitter.binding import Node, Parser, Point, Query, QuerySet  # noqa: F401
+from tree_sitter.binding import Range, Tree, TreeCursor  # noqa: F401
 
+# Loaded languages by language id, so that trees and queries can find the
+# library they came from when they are pickled.
+_languages = {}
 
-class Language:
+
+class Language(_Language):
     """A tree-sitter language"""
 
+    # The number of compiled queries each language keeps for reuse.
+    query_cache_size = 128
+
     @staticmethod
-    def build_library(output_path, repo_paths):
+    def build_library(
+        output_path, repo_paths, flags=None, link_flags=None, jobs=None, cache_dir=None
+    ):
         """
         Build a dynamic library at the given path, based on the parser
         repositories at the given paths.
 
         Returns `True` if the dynamic library was compiled and `False` if
-        the library already existed and was modified more recently than
-        any of the source files.
-        """
-        output_mtime = path.getmtime(output_path) if path.exists(output_path) else 0
+        the library already existed and was built from the same sources,
+        headers and flags.
 
+        Source files are compiled in parallel, using up to `jobs` processes
+        (one per CPU by default), with the extra compiler arguments in
+        `flags`, such as `["-O2"]`; `link_flags` are passed to the linker.
+        Object files are cached in `cache_dir` (by default, a directory next
+        to the output) under a hash of their sources and flags, so that
+        rebuilding only recompiles the grammars that changed.
+        """
         if not repo_paths:
             raise ValueError("Must provide at least one language folder")
 
@@ -38,38 +60,73 @@ class Language:
                 source_paths.append(path.join(src_path, "scanner.cc"))
             elif path.exists(path.join(src_path, "scanner.c")):
                 source_paths.append(path.join(src_path, "scanner.c"))
-        source_mtimes = [path.getmtime(__file__)] + [
-            path.getmtime(path_) for path_ in source_paths
+
+        source_preargs = []
+        for source_path in source_paths:
+            if system() == "Windows":
+                preargs = []
+            else:
+                preargs = ["-fPIC"]
+                if source_path.endswith(".c"):
+                    preargs.append("-std=c99")
+            source_preargs.append(preargs + (flags or []))
+        source_hashes = [
+            _source_hash(source_path, preargs)
+            for source_path, preargs in zip(source_paths, source_preargs)
         ]
 
+        # The library is up to date when it was linked from objects with
+        # the same hashes and the same link flags, recorded next to it.
+        build_hash = sha256(
+            "\0".join(source_hashes + (link_flags or [])).encode("utf8")
+        ).hexdigest()
+        hash_path = output_path + ".hash"
+        if path.exists(output_path) and path.exists(hash_path):
+            with open(hash_path) as file:
+                if file.read().strip() == build_hash:
+                    return False
+
         compiler = new_compiler()
         if cpp:
+            from ctypes.util import find_library
+
             if find_library("c++"):
                 compiler.add_library("c++")
             if find_library("stdc++"):
                 compiler.add_library("stdc++")
 
-        if max(source_mtimes) <= output_mtime:
-            return False
-
-        with TemporaryDirectory(suffix="tree_sitter_language") as out_dir:
-            object_paths = []
-            for source_path in source_paths:
-                if system() == "Windows":
-                    flags = None
-                else:
-                    flags = ["-fPIC"]
-                    if source_path.endswith(".c"):
-                        flags.append("-std=c99")
-                object_paths.append(
-                    compiler.compile(
-                        [source_path],
-                        output_dir=out_dir,
-                        include_dirs=[path.dirname(source_path)],
-                        extra_preargs=flags,
-                    )[0]
-                )
-            compiler.link_shared_object(object_paths, output_path)
+        if cache_dir is None:
+            cache_dir = output_path + ".cache"
+        makedirs(cache_dir, exist_ok=True)
+
+        def compile_source(source_path, preargs, source_hash):
+            object_path = path.join(cache_dir, source_hash + compiler.obj_extension)
+            if path.exists(object_path):
+                return object_path
+
+            # Each job compiles in its own directory with its own compiler,
+            # then moves the object into the cache, so a failed or concurrent
+            # build never leaves a partial object behind.
+            with TemporaryDirectory(suffix="tree_sitter_language") as out_dir:
+                compiled_path = new_compiler().compile(
+                    [source_path],
+                    output_dir=out_dir,
+                    include_dirs=[path.dirname(source_path)],
+                    extra_preargs=preargs or None,
+                )[0]
+                replace(compiled_path, object_path)
+            return object_path
+
+        # Compilers run as subprocesses, so threads are enough to use every CPU.
+        with ThreadPoolExecutor(max_workers=jobs or cpu_count() or 1) as executor:
+            object_paths = list(
+                executor.map(compile_source, source_paths, source_preargs, source_hashes)
+            )
+        compiler.link_shared_object(
+            object_paths, output_path, extra_postargs=link_flags or None
+        )
+        with open(hash_path, "w") as file:
+            file.write(build_hash + "\n")
         return True
 
     def __init__(self, library_path, name):
@@ -77,16 +134,286 @@ class Language:
         Load the language with the given name from the dynamic library
         at the given path.
         """
+        super().__init__(library_path, name)
         self.name = name
-        self.lib = cdll.LoadLibrary(library_path)
-        language_function = getattr(self.lib, "tree_sitter_%s" % name)
-        language_function.restype = c_void_p
-        self.language_id = language_function()
+        self.library_path = library_path
+        self._queries = OrderedDict()
+        self._queries_lock = Lock()
+        _languages.setdefault(self.language_id, self)
+
+    def __reduce__(self):
+        return (_load_language, (self.library_path, self.name))
 
     def field_id_for_name(self, name):
         """Return the field id for a field name."""
         return _language_field_id_for_name(self.language_id, name)
 
     def query(self, source):
-        """Create a Query with the given source code."""
-        return _language_query(self.language_id, source)
+        """
+        Create a Query with the given source code.
+
+        The most recently used compiled queries are cached by their source,
+        so creating the same query again returns the same Query object.
+        Queries can be shared between threads, but settings such as
+        `match_limit` are shared by every user of a cached query.
+        """
+        if isinstance(source, str):
+            source = source.encode("utf8")
+        with self._queries_lock:
+            query = self._queries.get(source)
+            if query is not None:
+                self._queries.move_to_end(source)
+                return query
+        query = _language_query(self.language_id, source)
+        with self._queries_lock:
+            query = self._queries.setdefault(source, query)
+            self._queries.move_to_end(source)
+            while len(self._queries) > max(self.query_cache_size, 0):
+                self._queries.popitem(last=False)
+        return query
+
+    def query_set(self, sources):
+        """
+        Create a QuerySet that runs several queries in a single traversal.
+
+        Each source may be query source code or a Query. The queries'
+        patterns are compiled together, and the set's `captures` and
+        `matches` methods return one list of results per source.
+        """
+        sources = [
+            source.source
+            if isinstance(source, Query)
+            else source.encode("utf8")
+            if isinstance(source, str)
+            else source
+            for source in sources
+        ]
+        pattern_counts = [self.query(source).pattern_count for source in sources]
+        return QuerySet(self.query(b"\n".join(sources)), pattern_counts)
+
+
+class ParserPool:
+    """
+    A pool of parsers, kept warm for each language.
+
+    Switching a parser's language discards its reusable internal state, so
+    jobs that interleave many languages should take parsers from a pool
+    instead. Parsers are checked out and returned without taking a lock, so
+    a pool can be shared by many threads.
+    """
+
+    def __init__(self, size=None):
+        """
+        Create a pool that keeps up to `size` idle parsers for each language
+        (by default, one per CPU). Size it to the number of worker threads.
+        """
+        self.size = size if size is not None else (cpu_count() or 1)
+        self._parsers = {}
+
+    @contextmanager
+    def parser(self, language):
+        """
+        Check out a parser for the given language for a `with` block.
+
+        The parser's included ranges, timeout, logging, DOT graphs and stats
+        collection are reset when it goes back to the pool, so settings made
+        inside the block only apply to that checkout.
+        """
+        # `dict.setdefault`, `deque.append` and `deque.pop` are atomic, so no
+        # lock is needed.
+        idle = self._parsers.setdefault(language.language_id, deque())
+        try:
+            parser = idle.pop()
+        except IndexError:
+            parser = Parser()
+            parser.set_language(language)
+        try:
+            yield parser
+        except BaseException:
+            # A failed parse may leave a halted parse behind; discard it so
+            # the parser can go back to the pool.
+            parser.reset()
+            raise
+        finally:
+            if len(idle) < self.size:
+                parser.set_included_ranges([])
+                parser.timeout_micros = 0
+                parser.disable_logging()
+                parser.print_dot_graphs(None)
+                parser.collect_stats = False
+                idle.append(parser)
+
+    def parse(self, language, source, old_tree=None):
+        """Parse source code in the given language with a pooled parser."""
+        with self.parser(language) as parser:
+            return parser.parse(source, old_tree)
+
+
+class TreeCache:
+    """
+    A cache of parsed trees, keyed by language and a hash of the source.
+
+    The least recently used trees are evicted once the cached trees, counted
+    by the `total` of their `memory_usage()` when they were parsed, add up to
+    more than `max_bytes`. Cached trees are shared, so don't edit a tree
+    returned by the cache; edit a `copy()` of it instead.
+    """
+
+    def __init__(self, max_bytes=64 * 1024 * 1024, pool=None):
+        """
+        Create a cache holding up to `max_bytes` of trees and their sources,
+        parsed with parsers from `pool` (by default, a new ParserPool).
+        """
+        self.max_bytes = max_bytes
+        self.pool = pool if pool is not None else ParserPool()
+        self.hits = 0
+        self.misses = 0
+        self._trees = OrderedDict()
+        self._paths = {}
+        self._size = 0
+        self._lock = Lock()
+
+    def __len__(self):
+        return len(self._trees)
+
+    def parse(self, language, source, path=None):
+        """
+        Parse source code in the given language, reusing the cached tree if
+        the same source was parsed before.
+
+        When `path` is given and the cache still holds the tree of the last
+        version parsed for that path, a changed source is parsed
+        incrementally from that tree, after an edit covering the bytes that
+        differ between the two versions. A tree whose source isn't available
+        is parsed from scratch instead.
+        """
+        if isinstance(source, str):
+            source = source.encode("utf8")
+        key = (language.language_id, sha256(source).digest())
+        with self._lock:
+            entry = self._trees.get(key)
+            if entry is not None:
+                self._trees.move_to_end(key)
+                self.hits += 1
+                if path is not None:
+                    self._paths[path] = key
+                return entry[0]
+            self.misses += 1
+            old_key = self._paths.get(path)
+            old_tree = None
+            if old_key is not None and old_key[0] == key[0]:
+                old_entry = self._trees.get(old_key)
+                if old_entry is not None and old_entry[0].text is not None:
+                    old_tree = old_entry[0]
+
+        if old_tree is not None:
+            old_tree = old_tree.copy()
+            old_tree.edit(*_source_edit(old_tree.text, source))
+        tree = self.pool.parse(language, source, old_tree)
+
+        with self._lock:
+            if key not in self._trees:
+                size = tree.memory_usage()["total"]
+                self._trees[key] = (tree, size)
+                self._size += size
+            if path is not None:
+                self._paths[path] = key
+            evicted_keys = set()
+            while self._size > self.max_bytes and self._trees:
+                evicted_key, (_, size) = self._trees.popitem(last=False)
+                self._size -= size
+                evicted_keys.add(evicted_key)
+            if evicted_keys:
+                self._paths = {
+                    path_: key_
+                    for path_, key_ in self._paths.items()
+                    if key_ not in evicted_keys
+                }
+        return tree
+
+    def clear(self):
+        """Remove every tree from the cache."""
+        with self._lock:
+            self._trees.clear()
+            self._paths.clear()
+            self._size = 0
+
+
+def _source_hash(source_path, flags):
+    """
+    Hash a source file, the headers next to it, and the flags it is compiled
+    with, to identify its object file.
+    """
+    digest = sha256()
+    digest.update("\0".join(flags).encode("utf8"))
+    src_path = path.dirname(source_path)
+    header_paths = []
+    for directory, _, file_names in walk(src_path):
+        header_paths.extend(
+            path.join(directory, name)
+            for name in file_names
+            if name.endswith((".h", ".hpp"))
+        )
+    for file_path in [source_path] + sorted(header_paths):
+        digest.update(b"\0" + path.relpath(file_path, src_path).encode("utf8") + b"\0")
+        with open(file_path, "rb") as file:
+            digest.update(file.read())
+    return digest.hexdigest()
+
+
+def _load_language(library_path, name):
+    for language in _languages.values():
+        if language.library_path == library_path and language.name == name:
+            return language
+    return Language(library_path, name)
+
+
+def _language_for_id(language_id, kind):
+    language = _languages.get(language_id)
+    if language is None:
+        raise PicklingError(
+            "Can't pickle %s whose language was not loaded through Language" % kind
+        )
+    return language
+
+
+def _reduce_tree(tree):
+    text = tree.text
+    if text is None:
+        raise PicklingError("Can't pickle a tree without its current source text")
+    language = _language_for_id(_tree_language_id(tree), "a tree")
+    return (_load_tree, (language, bytes(text), tree.included_ranges))
+
+
+def _load_tree(language, text, included_ranges=None):
+    parser = Parser()
+    parser.set_language(language)
+    if included_ranges is not None:
+        parser.set_included_ranges(included_ranges)
+    return parser.parse(text)
+
+
+def _reduce_query(query):
+    language = _language_for_id(_query_language_id(query), "a query")
+    return (_load_query, (language, query.source))
+
+
+def _load_query(language, source):
+    return language.query(source)
+
+
+def _reduce_range(range_):
+    return (
+        Range,
+        (
+            tuple(range_.start_point),
+            tuple(range_.end_point),
+            range_.start_byte,
+            range_.end_byte,
+        ),
+    )
+
+
+copyreg.pickle(Range, _reduce_range)
+copyreg.pickle(Tree, _reduce_tree)
+copyreg.pickle(Query, _reduce_query)
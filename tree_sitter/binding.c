@@ -1,8 +1,19 @@
 #define PY_SSIZE_T_CLEAN
 #include "Python.h"
+#include "structmember.h"
+#include <stdio.h>
+#include <time.h>
 #include <wctype.h>
 #include "tree_sitter/api.h"
 
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
 // Types
 
 typedef struct {
@@ -10,18 +21,107 @@ typedef struct {
   TSNode node;
   PyObject *children;
   PyObject *tree;
+  PyObject *named_children;
 } Node;
 
+// A node's children, as a sequence that creates `Node`s on demand. It refers
+// to the parent's tree rather than the parent `Node`, so the parent can cache
+// it without creating a reference cycle.
+typedef struct {
+  PyObject_HEAD
+  TSNode node;
+  PyObject *tree;
+  bool named;
+} NodeChildren;
+
+typedef struct {
+  PyObject_HEAD
+  TSTreeCursor cursor;
+  PyObject *tree;
+  bool named;
+  bool started;
+  bool done;
+} NodeChildrenIterator;
+
+typedef struct {
+  char *data;
+  size_t length;
+  size_t gap_start;
+  size_t gap_size;
+} TextBuffer;
+
+typedef struct {
+  Node **nodes;
+  size_t capacity;
+  size_t count;
+} NodeCache;
+
 typedef struct {
   PyObject_HEAD
   TSTree *tree;
   PyObject *source;
+  PyObject *source_view;
+  TextBuffer *text_buffer;
   int edited;
+  TSTreeCursor *cursor;
+  NodeCache *node_cache;
+  // The native memory allocated while parsing this tree, which it may share
+  // with its copies and with trees parsed incrementally from it.
+  size_t native_bytes;
+  bool cache_children;
+  // The included ranges of the parser that produced this tree, as a tuple of
+  // Ranges, or NULL if it parsed the whole document.
+  PyObject *included_ranges;
+  // The number of running parses that use this tree as their old tree. The
+  // tree can't be closed until they finish.
+  Py_ssize_t in_use;
 } Tree;
 
+typedef struct {
+  PyObject_HEAD
+  TSLanguage *language;
+} Language;
+
+// Log messages are appended to a buffer without calling into Python, one line
+// per message. Only every `sample`-th message is kept, and once the buffer
+// holds `max_bytes`, later messages are dropped until it is taken.
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+  size_t max_bytes;
+  uint32_t sample;
+  uint64_t message_count;
+} ParserLog;
+
+typedef struct {
+  double wall_time;
+  uint32_t bytes;
+  uint32_t node_count;
+  uint32_t error_count;
+  bool incremental;
+} ParseStats;
+
 typedef struct {
   PyObject_HEAD
   TSParser *parser;
+  PyThread_type_lock lock;
+  TSParser **pool;
+  size_t pool_size;
+  size_t cancellation_flag;
+  // The input of a parse that was halted by a timeout or cancellation, which
+  // is resumed if the same source and old tree are parsed again.
+  PyObject *halted_source;
+  PyObject *halted_old_tree;
+  // The thread holding the lock, or 0 if none does.
+  unsigned long owner;
+  // The ranges set with set_included_ranges, as a tuple of Ranges shared
+  // with the trees parsed over them, or NULL for the whole document.
+  PyObject *included_ranges;
+  ParserLog *log;
+  bool collect_stats;
+  bool has_stats;
+  ParseStats stats;
 } Parser;
 
 typedef struct {
@@ -31,44 +131,749 @@ typedef struct {
   PyObject *tree;
 } TreeCursor;
 
+typedef struct {
+  PyObject_HEAD
+  TSRange range;
+} Range;
+
+typedef enum {
+  QueryPredicateEq,
+  QueryPredicateMatch,
+  QueryPredicateAnyOf,
+} QueryPredicateKind;
+
+typedef struct {
+  uint64_t hash;
+  const char *string;
+  uint32_t length;
+} QueryStringSetEntry;
+
+typedef struct {
+  QueryPredicateKind kind;
+  bool negated;
+  uint32_t capture_id;
+  // For `#eq?`, either another capture, or `UINT32_MAX` to compare against
+  // `string` instead. Strings are owned by the `TSQuery`.
+  uint32_t other_capture_id;
+  const char *string;
+  uint32_t length;
+  // For `#match?`, the compiled regular expression.
+  PyObject *regex;
+  // For `#any-of?`, the strings sorted by hash.
+  QueryStringSetEntry *strings;
+  uint32_t string_count;
+} QueryPredicate;
+
+typedef struct {
+  PyObject_HEAD
+  TSTreeCursor cursor;
+  PyObject *tree;
+  uint32_t depth;
+  bool postorder;
+  bool started;
+  bool done;
+  bool skip_children;
+  bool named_only;
+  bool with_info;
+  bool has_range;
+  uint32_t start_byte;
+  uint32_t end_byte;
+  // When filtering by type, `symbols[symbol]` says whether to yield nodes
+  // with that symbol. Otherwise `symbols` is NULL.
+  bool *symbols;
+  uint32_t symbol_count;
+} NodeIterator;
+
 typedef struct {
   PyObject_HEAD
   TSQuery *query;
+  TSLanguage *language;
+  PyObject *source;
   PyObject *capture_names;
+  TSQueryCursor *cursor;
+  uint32_t match_limit;
+  QueryPredicate *predicates;
+  // The predicates of pattern `i` are `predicates[predicate_offsets[i]]` up
+  // to `predicates[predicate_offsets[i + 1]]`.
+  uint32_t *predicate_offsets;
+  uint32_t pattern_count;
+  // Counters for `Query.stats`, updated by every execution.
+  bool did_exceed_match_limit;
+  uint64_t executions;
+  uint64_t matches_examined;
+  uint64_t captures_emitted;
+  uint64_t match_limit_exceeded;
 } Query;
 
-static TSTreeCursor default_cursor = {0};
-static TSQueryCursor *query_cursor = NULL;
+typedef struct {
+  PyObject_HEAD
+  PyObject *tree;
+  PyObject *capture_names;
+  TSNode *nodes;
+  Py_ssize_t length;
+  PyObject *capture_index;
+  PyObject *start_byte;
+  PyObject *end_byte;
+  PyObject *start_row;
+  PyObject *start_column;
+  PyObject *end_row;
+  PyObject *end_column;
+  PyObject *symbol;
+} CaptureArrays;
+
+typedef struct {
+  Node *node;
+  TSPoint start_point;
+  TSPoint end_point;
+  uint32_t start_byte;
+  uint32_t end_byte;
+  PyObject *ranges;
+} QueryExecArgs;
+
+// The most recent matches that a loop over captures found to satisfy their
+// predicates. A match is returned once for each of its captures, interleaved
+// with the other matches in progress, so remembering their ids means each
+// match's predicates are usually checked only once.
+#define CHECKED_MATCH_COUNT 8
+
+typedef struct {
+  uint32_t ids[CHECKED_MATCH_COUNT];
+  uint32_t count;
+  uint32_t next;
+} CheckedMatches;
+
+typedef struct {
+  PyObject_HEAD
+  Query *query;
+  PyObject *tree;
+  TSQueryCursor *cursor;
+  int captures;
+  CheckedMatches checked;
+} QueryIterator;
+
+typedef struct {
+  PyObject_HEAD
+  Query *query;
+  uint32_t query_count;
+  // Pattern `i` of the combined query is pattern `i - pattern_offsets[g]` of
+  // query `g = pattern_groups[i]`.
+  uint32_t *pattern_groups;
+  uint32_t *pattern_offsets;
+} QuerySet;
+
+// Allocation
+
+// setup.py builds the tree-sitter core with TREE_SITTER_ALLOCATION_TRACKING,
+// which makes 0.19's `alloc.h` declare the `ts_record_` functions below and
+// send its `ts_malloc` family of allocations to them, so that the binding can
+// account for the memory that trees and parsers use. Each allocation is
+// prefixed with its size. The totals are kept for the whole process and for
+// each thread, which lets a parse measure what it allocated while other
+// threads are parsing.
+#define ALLOCATION_HEADER_SIZE 16
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#define allocation_add(total, count) InterlockedExchangeAdd64((total), (count))
+#else
+#define THREAD_LOCAL __thread
+#define allocation_add(total, count) __atomic_fetch_add((total), (count), __ATOMIC_RELAXED)
+#endif
+
+static int64_t allocated_bytes;
+static THREAD_LOCAL int64_t thread_allocated_bytes;
+
+// Set by the first allocation routed here. Memory that the core returns, such
+// as the string from `ts_node_string`, is freed with `core_free`, which only
+// expects a size prefix when the core's allocations reach these functions.
+static volatile bool allocations_routed;
+
+static void *allocation_finish(char *block, size_t size) {
+  // Like tree-sitter's own allocator, give up when memory runs out, since the
+  // core doesn't check for failed allocations.
+  if (!block) {
+    fprintf(stderr, "tree-sitter failed to allocate %zu bytes\n", size);
+    abort();
+  }
+  *(size_t *)block = size;
+  allocations_routed = true;
+  allocation_add(&allocated_bytes, (int64_t)size);
+  thread_allocated_bytes += (int64_t)size;
+  return block + ALLOCATION_HEADER_SIZE;
+}
+
+void *ts_record_malloc(size_t size) {
+  return allocation_finish(malloc(size + ALLOCATION_HEADER_SIZE), size);
+}
+
+void *ts_record_calloc(size_t count, size_t size) {
+  if (size && count > (SIZE_MAX - ALLOCATION_HEADER_SIZE) / size) {
+    return allocation_finish(NULL, SIZE_MAX);
+  }
+  return allocation_finish(calloc(1, count * size + ALLOCATION_HEADER_SIZE), count * size);
+}
+
+void ts_record_free(void *pointer) {
+  if (!pointer) return;
+  char *block = (char *)pointer - ALLOCATION_HEADER_SIZE;
+  size_t size = *(size_t *)block;
+  allocation_add(&allocated_bytes, -(int64_t)size);
+  thread_allocated_bytes -= (int64_t)size;
+  free(block);
+}
+
+void *ts_record_realloc(void *pointer, size_t size) {
+  if (!pointer) return ts_record_malloc(size);
+  char *block = (char *)pointer - ALLOCATION_HEADER_SIZE;
+  size_t old_size = *(size_t *)block;
+  block = realloc(block, size + ALLOCATION_HEADER_SIZE);
+  if (block) {
+    allocation_add(&allocated_bytes, -(int64_t)old_size);
+    thread_allocated_bytes -= (int64_t)old_size;
+  }
+  return allocation_finish(block, size);
+}
+
+// Some builds of the core use this to pause the recording of allocations in
+// its own tests. The binding always records them.
+bool ts_toggle_allocation_recording(bool value) {
+  (void)value;
+  return true;
+}
+
+static void core_free(void *pointer) {
+  if (allocations_routed) ts_record_free(pointer);
+  else free(pointer);
+}
+
+// The bytes this thread has allocated, net of what it freed, since it read
+// `thread_allocated_bytes` as `start`.
+static size_t allocation_since(int64_t start) {
+  int64_t count = thread_allocated_bytes - start;
+  return count > 0 ? (size_t)count : 0;
+}
+
+// Arguments
+
+// Methods on hot paths use METH_FASTCALL, which passes positional arguments as
+// an array followed by the values of the keyword arguments named in `kwnames`,
+// without building an args tuple or a kwargs dict. Match them up with
+// `keywords`, storing a borrowed reference for each parameter in `values`,
+// which the caller initializes to NULL. The first `required` parameters must
+// be given.
+static int parse_fastcall_args(
+  const char *function,
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames,
+  const char *const *keywords,
+  Py_ssize_t required,
+  PyObject **values
+) {
+  Py_ssize_t count = 0;
+  while (keywords[count]) count++;
+  if (nargs > count) {
+    PyErr_Format(
+      PyExc_TypeError,
+      "%s() takes at most %zd positional arguments (%zd given)",
+      function,
+      count,
+      nargs
+    );
+    return -1;
+  }
+  for (Py_ssize_t i = 0; i < nargs; i++) values[i] = args[i];
+
+  Py_ssize_t kwcount = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+  for (Py_ssize_t i = 0; i < kwcount; i++) {
+    PyObject *name = PyTuple_GET_ITEM(kwnames, i);
+    Py_ssize_t j = 0;
+    while (j < count && PyUnicode_CompareWithASCIIString(name, keywords[j]) != 0) j++;
+    if (j == count) {
+      PyErr_Format(PyExc_TypeError, "%s() got an unexpected keyword argument '%U'", function, name);
+      return -1;
+    }
+    if (values[j]) {
+      PyErr_Format(PyExc_TypeError, "%s() got multiple values for argument '%s'", function, keywords[j]);
+      return -1;
+    }
+    values[j] = args[nargs + i];
+  }
+
+  for (Py_ssize_t i = 0; i < required; i++) {
+    if (!values[i]) {
+      PyErr_Format(PyExc_TypeError, "%s() missing required argument '%s'", function, keywords[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int uint32_from_arg(PyObject *arg, uint32_t *result) {
+  unsigned long value = PyLong_AsUnsignedLong(arg);
+  if (value == (unsigned long)-1 && PyErr_Occurred()) return -1;
+  if (value > UINT32_MAX) {
+    PyErr_SetString(PyExc_OverflowError, "Value is too large");
+    return -1;
+  }
+  *result = (uint32_t)value;
+  return 0;
+}
 
 // Point
 
+// Points are struct sequences: tuples that also have `row` and `column`
+// attributes, so they still compare equal to plain (row, column) tuples.
+static PyStructSequence_Field point_fields[] = {
+  {"row", "The zero-based row"},
+  {"column", "The zero-based column, in bytes"},
+  {NULL},
+};
+
+static PyStructSequence_Desc point_desc = {
+  .name = "tree_sitter.Point",
+  .doc = "A (row, column) position in a document",
+  .fields = point_fields,
+  .n_in_sequence = 2,
+};
+
+static PyTypeObject point_type;
+
 static PyObject *point_new(TSPoint point) {
-  PyObject *row = PyLong_FromSize_t((size_t)point.row);
-  PyObject *column = PyLong_FromSize_t((size_t)point.column);
+  PyObject *result = PyStructSequence_New(&point_type);
+  if (result == NULL) return NULL;
+  PyObject *row = PyLong_FromUnsignedLong(point.row);
+  PyObject *column = PyLong_FromUnsignedLong(point.column);
   if (!row || !column) {
     Py_XDECREF(row);
     Py_XDECREF(column);
+    Py_DECREF(result);
+    return NULL;
+  }
+  PyStructSequence_SET_ITEM(result, 0, row);
+  PyStructSequence_SET_ITEM(result, 1, column);
+  return result;
+}
+
+// Convert a (row, column) pair. Tuples of ints, including points, are read
+// directly; other sequences go through the slower argument parser.
+static int point_parse(PyObject *arg, TSPoint *point) {
+  if (PyTuple_Check(arg) && PyTuple_GET_SIZE(arg) == 2) {
+    PyObject *row = PyTuple_GET_ITEM(arg, 0);
+    PyObject *column = PyTuple_GET_ITEM(arg, 1);
+    if (PyLong_Check(row) && PyLong_Check(column)) {
+      if (uint32_from_arg(row, &point->row) < 0) return -1;
+      return uint32_from_arg(column, &point->column);
+    }
+  }
+  if (!PyArg_Parse(arg, "(II)", &point->row, &point->column)) return -1;
+  return 0;
+}
+
+// Like `point_parse`, but only accept tuples.
+static int point_from_arg(PyObject *arg, const char *name, TSPoint *point) {
+  if (!PyTuple_Check(arg)) {
+    PyErr_Format(PyExc_TypeError, "%s must be a (row, column) tuple", name);
+    return -1;
+  }
+  return point_parse(arg, point);
+}
+
+// Range
+
+static PyObject *range_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+  char *keywords[] = {
+    "start_point",
+    "end_point",
+    "start_byte",
+    "end_byte",
+    NULL,
+  };
+
+  TSRange range;
+  PyObject *start_point, *end_point;
+  int ok = PyArg_ParseTupleAndKeywords(
+    args,
+    kwargs,
+    "OOII",
+    keywords,
+    &start_point,
+    &end_point,
+    &range.start_byte,
+    &range.end_byte
+  );
+  if (!ok) return NULL;
+  if (point_parse(start_point, &range.start_point) < 0) return NULL;
+  if (point_parse(end_point, &range.end_point) < 0) return NULL;
+
+  Range *self = (Range *)type->tp_alloc(type, 0);
+  if (self != NULL) self->range = range;
+  return (PyObject *)self;
+}
+
+static void range_dealloc(Range *self) {
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *range_repr(Range *self) {
+  return PyUnicode_FromFormat(
+    "<Range start_point=(%u, %u), start_byte=%u, end_point=(%u, %u), end_byte=%u>",
+    self->range.start_point.row,
+    self->range.start_point.column,
+    self->range.start_byte,
+    self->range.end_point.row,
+    self->range.end_point.column,
+    self->range.end_byte
+  );
+}
+
+static bool range_is_instance(PyObject *self);
+
+static PyObject *range_compare(Range *self, PyObject *other, int op) {
+  if (!range_is_instance(other) || (op != Py_EQ && op != Py_NE)) {
+    Py_RETURN_NOTIMPLEMENTED;
+  }
+  TSRange *a = &self->range;
+  TSRange *b = &((Range *)other)->range;
+  bool result =
+    a->start_byte == b->start_byte &&
+    a->end_byte == b->end_byte &&
+    a->start_point.row == b->start_point.row &&
+    a->start_point.column == b->start_point.column &&
+    a->end_point.row == b->end_point.row &&
+    a->end_point.column == b->end_point.column;
+  return PyBool_FromLong(op == Py_EQ ? result : !result);
+}
+
+static PyObject *range_get_start_point(Range *self, void *payload) {
+  return point_new(self->range.start_point);
+}
+
+static PyObject *range_get_end_point(Range *self, void *payload) {
+  return point_new(self->range.end_point);
+}
+
+static PyObject *range_get_start_byte(Range *self, void *payload) {
+  return PyLong_FromSize_t((size_t)self->range.start_byte);
+}
+
+static PyObject *range_get_end_byte(Range *self, void *payload) {
+  return PyLong_FromSize_t((size_t)self->range.end_byte);
+}
+
+static PyGetSetDef range_accessors[] = {
+  {"start_point", (getter)range_get_start_point, NULL, "The start point of this range", NULL},
+  {"end_point", (getter)range_get_end_point, NULL, "The end point of this range", NULL},
+  {"start_byte", (getter)range_get_start_byte, NULL, "The start byte of this range", NULL},
+  {"end_byte", (getter)range_get_end_byte, NULL, "The end byte of this range", NULL},
+  {NULL}
+};
+
+static PyTypeObject range_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.Range",
+  .tp_doc = "A range within a document",
+  .tp_basicsize = sizeof(Range),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_new = range_new,
+  .tp_dealloc = (destructor)range_dealloc,
+  .tp_repr = (reprfunc)range_repr,
+  .tp_richcompare = (richcmpfunc)range_compare,
+  .tp_getset = range_accessors,
+};
+
+static PyObject *range_new_internal(TSRange range) {
+  Range *self = (Range *)range_type.tp_alloc(&range_type, 0);
+  if (self != NULL) self->range = range;
+  return (PyObject *)self;
+}
+
+static bool range_is_instance(PyObject *self) {
+  return PyObject_IsInstance(self, (PyObject *)&range_type);
+}
+
+// Columns
+
+// Bulk exports hand back packed arrays as typed memoryviews over bytes
+// objects, which NumPy and other buffer consumers can use without copying.
+
+// Allocate an uninitialized column of `length` items. The column is a bytes
+// object until it is filled in and turned into a typed view.
+static PyObject *column_new(Py_ssize_t length, size_t item_size, void **data) {
+  PyObject *column = PyBytes_FromStringAndSize(NULL, length * item_size);
+  if (column) *data = PyBytes_AS_STRING(column);
+  return column;
+}
+
+// Steals the reference to `column`.
+static PyObject *column_view(PyObject *column, const char *format) {
+  PyObject *view = PyMemoryView_FromObject(column);
+  Py_DECREF(column);
+  if (view == NULL) return NULL;
+  PyObject *result = PyObject_CallMethod(view, "cast", "s", format);
+  Py_DECREF(view);
+  return result;
+}
+
+// TextBuffer
+
+// A gap buffer holding the source of a tree that has been edited with
+// replacement text. Edits near each other, as when typing, only move a few
+// bytes across the gap instead of copying the whole source.
+
+static TextBuffer *text_buffer_new(const char *data, size_t length) {
+  TextBuffer *self = PyMem_Malloc(sizeof(TextBuffer));
+  if (self == NULL) return NULL;
+  size_t gap_size = length / 8 + 64;
+  self->data = PyMem_Malloc(length + gap_size);
+  if (self->data == NULL) {
+    PyMem_Free(self);
+    return NULL;
+  }
+  memcpy(self->data, data, length);
+  self->length = length;
+  self->gap_start = length;
+  self->gap_size = gap_size;
+  return self;
+}
+
+static void text_buffer_delete(TextBuffer *self) {
+  if (self == NULL) return;
+  PyMem_Free(self->data);
+  PyMem_Free(self);
+}
+
+static void text_buffer_move_gap(TextBuffer *self, size_t position) {
+  if (position < self->gap_start) {
+    size_t count = self->gap_start - position;
+    memmove(self->data + position + self->gap_size, self->data + position, count);
+  } else if (position > self->gap_start) {
+    size_t count = position - self->gap_start;
+    memmove(self->data + self->gap_start, self->data + self->gap_start + self->gap_size, count);
+  }
+  self->gap_start = position;
+}
+
+// Replace the bytes in `[start, old_end)` with `text`. The caller must check
+// that the range lies within the buffer.
+static int text_buffer_replace(
+  TextBuffer *self,
+  size_t start,
+  size_t old_end,
+  const char *text,
+  size_t text_length
+) {
+  size_t removed = old_end - start;
+  if (text_length > self->gap_size + removed) {
+    size_t tail_length = self->length - self->gap_start;
+    size_t gap_size = text_length + (self->length + text_length) / 8 + 64;
+    char *data = PyMem_Realloc(self->data, self->length + gap_size);
+    if (data == NULL) return -1;
+    memmove(data + self->gap_start + gap_size, data + self->gap_start + self->gap_size, tail_length);
+    self->data = data;
+    self->gap_size = gap_size;
+  }
+
+  text_buffer_move_gap(self, old_end);
+  self->gap_start = start;
+  self->gap_size += removed;
+  self->length -= removed;
+
+  memcpy(self->data + self->gap_start, text, text_length);
+  self->gap_start += text_length;
+  self->gap_size -= text_length;
+  self->length += text_length;
+  return 0;
+}
+
+static TextBuffer *text_buffer_clone(const TextBuffer *self) {
+  TextBuffer *result = PyMem_Malloc(sizeof(TextBuffer));
+  if (result == NULL) return NULL;
+  result->data = PyMem_Malloc(self->length + self->gap_size);
+  if (result->data == NULL) {
+    PyMem_Free(result);
+    return NULL;
+  }
+  memcpy(result->data, self->data, self->length + self->gap_size);
+  result->length = self->length;
+  result->gap_start = self->gap_start;
+  result->gap_size = self->gap_size;
+  return result;
+}
+
+static void text_buffer_copy(TextBuffer *self, size_t start, size_t end, char *destination) {
+  if (end > self->length) end = self->length;
+  if (start >= end) return;
+  if (start < self->gap_start) {
+    size_t count = (end < self->gap_start ? end : self->gap_start) - start;
+    memcpy(destination, self->data + start, count);
+    destination += count;
+    start += count;
+  }
+  if (start < end) {
+    memcpy(destination, self->data + self->gap_size + start, end - start);
+  }
+}
+
+static PyObject *text_buffer_get_bytes(TextBuffer *self, size_t start, size_t end) {
+  if (end > self->length) end = self->length;
+  if (start > end) start = end;
+  PyObject *result = PyBytes_FromStringAndSize(NULL, end - start);
+  if (result) text_buffer_copy(self, start, end, PyBytes_AS_STRING(result));
+  return result;
+}
+
+// A `TSInput` read function that parses straight out of the gap buffer.
+static const char *text_buffer_read(
+  void *payload,
+  uint32_t byte_offset,
+  TSPoint position,
+  uint32_t *bytes_read
+) {
+  TextBuffer *self = (TextBuffer *)payload;
+  if (byte_offset < self->gap_start) {
+    *bytes_read = (uint32_t)(self->gap_start - byte_offset);
+    return self->data + byte_offset;
+  }
+  if (byte_offset < self->length) {
+    *bytes_read = (uint32_t)(self->length - byte_offset);
+    return self->data + self->gap_size + byte_offset;
+  }
+  *bytes_read = 0;
+  return "";
+}
+
+// NodeCache
+
+// When a tree interns its nodes, it keeps an open-addressing table of the
+// live `Node` objects wrapping its syntax nodes, keyed by node id. The table
+// holds borrowed references: each node removes itself when it's deallocated,
+// so interning never keeps a node alive.
+
+static size_t node_cache_slot(NodeCache *self, const void *id) {
+  uintptr_t hash = (uintptr_t)id;
+  hash ^= hash >> 17;
+  hash *= (uintptr_t)0x9E3779B97F4A7C15ULL;
+  return (size_t)(hash >> 7) & (self->capacity - 1);
+}
+
+static NodeCache *node_cache_new(void) {
+  NodeCache *self = PyMem_Malloc(sizeof(NodeCache));
+  if (self == NULL) return NULL;
+  self->capacity = 64;
+  self->count = 0;
+  self->nodes = PyMem_Calloc(self->capacity, sizeof(Node *));
+  if (self->nodes == NULL) {
+    PyMem_Free(self);
     return NULL;
   }
+  return self;
+}
+
+static void node_cache_delete(NodeCache *self) {
+  if (self == NULL) return;
+  PyMem_Free(self->nodes);
+  PyMem_Free(self);
+}
+
+static Node *node_cache_get(NodeCache *self, TSNode node) {
+  size_t mask = self->capacity - 1;
+  for (size_t i = node_cache_slot(self, node.id);; i = (i + 1) & mask) {
+    Node *entry = self->nodes[i];
+    if (entry == NULL) return NULL;
+    if (ts_node_eq(entry->node, node)) return entry;
+  }
+}
+
+static void node_cache_insert(NodeCache *self, Node *node) {
+  if ((self->count + 1) * 2 > self->capacity) {
+    Node **nodes = PyMem_Calloc(self->capacity * 2, sizeof(Node *));
+    // Interning is an optimization, so just skip it when out of memory.
+    if (nodes == NULL) return;
+    Node **old_nodes = self->nodes;
+    size_t old_capacity = self->capacity;
+    self->nodes = nodes;
+    self->capacity *= 2;
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old_nodes[i] == NULL) continue;
+      size_t slot = node_cache_slot(self, old_nodes[i]->node.id);
+      while (self->nodes[slot]) slot = (slot + 1) & (self->capacity - 1);
+      self->nodes[slot] = old_nodes[i];
+    }
+    PyMem_Free(old_nodes);
+  }
+  size_t slot = node_cache_slot(self, node->node.id);
+  while (self->nodes[slot]) slot = (slot + 1) & (self->capacity - 1);
+  self->nodes[slot] = node;
+  self->count++;
+}
+
+static void node_cache_remove(NodeCache *self, Node *node) {
+  size_t mask = self->capacity - 1;
+  size_t slot = node_cache_slot(self, node->node.id);
+  while (self->nodes[slot] != node) {
+    if (self->nodes[slot] == NULL) return;
+    slot = (slot + 1) & mask;
+  }
 
-  PyObject *obj = PyTuple_Pack(2, row, column);
-  Py_XDECREF(row);
-  Py_XDECREF(column);
-  return obj;
+  // Shift later entries of the probe sequence back, so lookups never stop
+  // early at the hole.
+  self->nodes[slot] = NULL;
+  self->count--;
+  for (size_t i = (slot + 1) & mask; self->nodes[i]; i = (i + 1) & mask) {
+    Node *entry = self->nodes[i];
+    size_t home = node_cache_slot(self, entry->node.id);
+    if (((i - home) & mask) >= ((i - slot) & mask)) {
+      self->nodes[slot] = entry;
+      self->nodes[i] = NULL;
+      slot = i;
+    }
+  }
 }
 
 // Node
 
+// Recently deallocated nodes are kept for reuse, since traversals create and
+// drop huge numbers of them.
+#define NODE_FREE_LIST_SIZE 256
+#ifndef PYPY_VERSION
+static Node *node_free_list[NODE_FREE_LIST_SIZE];
+static int node_free_list_count = 0;
+#endif
+
 static PyObject *node_new_internal(TSNode node, PyObject *tree);
+static TSTreeCursor *tree_take_cursor(Tree *self, TSNode node);
+static void tree_give_cursor(Tree *self, TSTreeCursor *cursor);
 static PyObject *tree_cursor_new_internal(TSNode node, PyObject *tree);
+static PyObject *node_iterator_new_internal(TSNode node, PyObject *tree, PyObject *args, PyObject *kwargs);
+static PyObject *node_children_new_internal(TSNode node, PyObject *tree, bool named);
+
+// A closed tree has freed its syntax nodes, so objects that refer to them
+// must check that the tree is still open before reading them.
+static bool tree_check_open(PyObject *tree) {
+  if (((Tree *)tree)->tree) return true;
+  PyErr_SetString(PyExc_ValueError, "Tree is closed");
+  return false;
+}
 
 static void node_dealloc(Node *self) {
+  Tree *tree = (Tree *)self->tree;
+  if (tree && tree->node_cache) node_cache_remove(tree->node_cache, self);
   Py_XDECREF(self->children);
+  Py_XDECREF(self->named_children);
   Py_XDECREF(self->tree);
+#ifndef PYPY_VERSION
+  if (node_free_list_count < NODE_FREE_LIST_SIZE) {
+    node_free_list[node_free_list_count++] = self;
+    return;
+  }
+#endif
   Py_TYPE(self)->tp_free(self);
 }
 
 static PyObject *node_repr(Node *self) {
+  if (!((Tree *)self->tree)->tree) return PyUnicode_FromString("<Node of a closed tree>");
   const char *type = ts_node_type(self->node);
   TSPoint start_point = ts_node_start_point(self->node);
   TSPoint end_point = ts_node_end_point(self->node);
@@ -103,7 +908,7 @@ static PyObject *node_compare(Node *self, Node *other, int op) {
 static PyObject *node_sexp(Node *self, PyObject *args) {
   char *string = ts_node_string(self->node);
   PyObject *result = PyUnicode_FromString(string);
-  free(string);
+  core_free(string);
   return result;
 }
 
@@ -111,35 +916,200 @@ static PyObject *node_walk(Node *self, PyObject *args) {
   return tree_cursor_new_internal(self->node, self->tree);
 }
 
-static PyObject *node_chield_by_field_id(Node *self, PyObject *args) {
-  TSFieldId field_id;
-  if (!PyArg_ParseTuple(args, "H", &field_id)) {
-    return NULL;
+static PyObject *node_descendants(Node *self, PyObject *args, PyObject *kwargs) {
+  return node_iterator_new_internal(self->node, self->tree, args, kwargs);
+}
+
+// Field ids by name, with one dict per language. There are only ever a few
+// languages, so they are found with a linear search.
+typedef struct {
+  const TSLanguage *language;
+  PyObject *field_ids;
+} FieldIdCache;
+
+static FieldIdCache *field_id_caches;
+static size_t field_id_cache_count;
+
+// Look up a field id by name, returning 0 if the language has no such field.
+static int language_field_id(const TSLanguage *language, PyObject *name, TSFieldId *field_id) {
+  PyObject *field_ids = NULL;
+  for (size_t i = 0; i < field_id_cache_count; i++) {
+    if (field_id_caches[i].language == language) {
+      field_ids = field_id_caches[i].field_ids;
+      break;
+    }
   }
-  TSNode child = ts_node_child_by_field_id(self->node, field_id);
+  if (field_ids == NULL) {
+    field_ids = PyDict_New();
+    if (field_ids == NULL) return -1;
+    FieldIdCache *caches = PyMem_Realloc(
+      field_id_caches, (field_id_cache_count + 1) * sizeof(FieldIdCache)
+    );
+    if (caches == NULL) {
+      Py_DECREF(field_ids);
+      PyErr_NoMemory();
+      return -1;
+    }
+    field_id_caches = caches;
+    field_id_caches[field_id_cache_count].language = language;
+    field_id_caches[field_id_cache_count].field_ids = field_ids;
+    field_id_cache_count++;
+  }
+
+  PyObject *cached = PyDict_GetItemWithError(field_ids, name);
+  if (cached) {
+    *field_id = (TSFieldId)PyLong_AsUnsignedLong(cached);
+    return 0;
+  }
+  if (PyErr_Occurred()) return -1;
+
+  Py_ssize_t length;
+  const char *string = PyUnicode_AsUTF8AndSize(name, &length);
+  if (string == NULL) return -1;
+  *field_id = ts_language_field_id_for_name(language, string, length);
+  // Only cache names that exist, so that arbitrary names can't grow the cache.
+  if (*field_id == 0) return 0;
+  PyObject *value = PyLong_FromUnsignedLong(*field_id);
+  if (value == NULL) return -1;
+  int status = PyDict_SetItem(field_ids, name, value);
+  Py_DECREF(value);
+  return status;
+}
+
+static PyObject *node_chield_by_field_id(Node *self, PyObject *arg) {
+  uint32_t field_id;
+  if (uint32_from_arg(arg, &field_id) < 0) return NULL;
+  if (field_id > UINT16_MAX) {
+    Py_RETURN_NONE;
+  }
+  TSNode child = ts_node_child_by_field_id(self->node, (TSFieldId)field_id);
   if (ts_node_is_null(child)) {
     Py_RETURN_NONE;
   }
   return node_new_internal(child, self->tree);
 }
 
-static PyObject *node_chield_by_field_name(Node *self, PyObject *args) {
-  char *name;
-  Py_ssize_t length;
-  if (!PyArg_ParseTuple(args, "s#", &name, &length)) {
+static PyObject *node_chield_by_field_name(Node *self, PyObject *arg) {
+  if (!PyUnicode_Check(arg)) {
+    PyErr_SetString(PyExc_TypeError, "Field name must be a string");
     return NULL;
   }
-  TSNode child = ts_node_child_by_field_name(self->node, name, length);
+  TSFieldId field_id;
+  if (language_field_id(ts_tree_language(((Tree *)self->tree)->tree), arg, &field_id) < 0) {
+    return NULL;
+  }
+  if (field_id == 0) {
+    Py_RETURN_NONE;
+  }
+  TSNode child = ts_node_child_by_field_id(self->node, field_id);
   if (ts_node_is_null(child)) {
     Py_RETURN_NONE;
   }
   return node_new_internal(child, self->tree);
 }
 
-static PyObject *node_get_type(Node *self, void *payload) {
+static PyObject *node_descendant_for_byte_range_internal(
+  Node *self,
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames,
+  bool named
+) {
+  static const char *const keywords[] = {"start_byte", "end_byte", NULL};
+  PyObject *values[2] = {NULL, NULL};
+  uint32_t start_byte, end_byte;
+  if (
+    parse_fastcall_args(
+      named ? "named_descendant_for_byte_range" : "descendant_for_byte_range",
+      args, nargs, kwnames, keywords, 2, values
+    ) < 0 ||
+    uint32_from_arg(values[0], &start_byte) < 0 ||
+    uint32_from_arg(values[1], &end_byte) < 0
+  ) {
+    return NULL;
+  }
+  TSNode descendant = named
+    ? ts_node_named_descendant_for_byte_range(self->node, start_byte, end_byte)
+    : ts_node_descendant_for_byte_range(self->node, start_byte, end_byte);
+  if (ts_node_is_null(descendant)) {
+    Py_RETURN_NONE;
+  }
+  return node_new_internal(descendant, self->tree);
+}
+
+static PyObject *node_descendant_for_point_range_internal(
+  Node *self,
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames,
+  bool named
+) {
+  static const char *const keywords[] = {"start_point", "end_point", NULL};
+  PyObject *values[2] = {NULL, NULL};
+  TSPoint start_point, end_point;
+  if (
+    parse_fastcall_args(
+      named ? "named_descendant_for_point_range" : "descendant_for_point_range",
+      args, nargs, kwnames, keywords, 2, values
+    ) < 0 ||
+    point_from_arg(values[0], "start_point", &start_point) < 0 ||
+    point_from_arg(values[1], "end_point", &end_point) < 0
+  ) {
+    return NULL;
+  }
+  TSNode descendant = named
+    ? ts_node_named_descendant_for_point_range(self->node, start_point, end_point)
+    : ts_node_descendant_for_point_range(self->node, start_point, end_point);
+  if (ts_node_is_null(descendant)) {
+    Py_RETURN_NONE;
+  }
+  return node_new_internal(descendant, self->tree);
+}
+
+static PyObject *node_descendant_for_byte_range(
+  Node *self,
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames
+) {
+  return node_descendant_for_byte_range_internal(self, args, nargs, kwnames, false);
+}
+
+static PyObject *node_named_descendant_for_byte_range(
+  Node *self,
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames
+) {
+  return node_descendant_for_byte_range_internal(self, args, nargs, kwnames, true);
+}
+
+static PyObject *node_descendant_for_point_range(
+  Node *self,
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames
+) {
+  return node_descendant_for_point_range_internal(self, args, nargs, kwnames, false);
+}
+
+static PyObject *node_named_descendant_for_point_range(
+  Node *self,
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames
+) {
+  return node_descendant_for_point_range_internal(self, args, nargs, kwnames, true);
+}
+
+static PyObject *node_get_type(Node *self, void *payload) {
   return PyUnicode_FromString(ts_node_type(self->node));
 }
 
+static PyObject *node_get_symbol(Node *self, void *payload) {
+  return PyLong_FromLong(ts_node_symbol(self->node));
+}
+
 static PyObject *node_get_is_named(Node *self, void *payload) {
   return PyBool_FromLong(ts_node_is_named(self->node));
 }
@@ -173,26 +1143,45 @@ static PyObject *node_get_end_point(Node *self, void *payload) {
 }
 
 static PyObject *node_get_children(Node *self, void *payload) {
-  if (self->children) {
-    Py_INCREF(self->children);
-    return self->children;
+  if (!((Tree *)self->tree)->cache_children) {
+    return node_children_new_internal(self->node, self->tree, false);
+  }
+  if (!self->children) {
+    self->children = node_children_new_internal(self->node, self->tree, false);
+    if (!self->children) return NULL;
   }
+  Py_INCREF(self->children);
+  return self->children;
+}
 
-  long length = (long)ts_node_child_count(self->node);
-  PyObject *result = PyList_New(length);
-  if (length > 0) {
-    ts_tree_cursor_reset(&default_cursor, self->node);
-    ts_tree_cursor_goto_first_child(&default_cursor);
-    int i = 0;
-    do {
-      TSNode child = ts_tree_cursor_current_node(&default_cursor);
-      PyList_SetItem(result, i, node_new_internal(child, self->tree));
-      i++;
-    } while (ts_tree_cursor_goto_next_sibling(&default_cursor));
-  }
-  Py_INCREF(result);
-  self->children = result;
-  return result;
+static PyObject *node_get_named_children(Node *self, void *payload) {
+  if (!((Tree *)self->tree)->cache_children) {
+    return node_children_new_internal(self->node, self->tree, true);
+  }
+  if (!self->named_children) {
+    self->named_children = node_children_new_internal(self->node, self->tree, true);
+    if (!self->named_children) return NULL;
+  }
+  Py_INCREF(self->named_children);
+  return self->named_children;
+}
+
+static PyObject *node_child(Node *self, PyObject *arg) {
+  Py_ssize_t index = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+  if (index == -1 && PyErr_Occurred()) return NULL;
+  if (index < 0 || (size_t)index >= ts_node_child_count(self->node)) {
+    Py_RETURN_NONE;
+  }
+  return node_new_internal(ts_node_child(self->node, (uint32_t)index), self->tree);
+}
+
+static PyObject *node_named_child(Node *self, PyObject *arg) {
+  Py_ssize_t index = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+  if (index == -1 && PyErr_Occurred()) return NULL;
+  if (index < 0 || (size_t)index >= ts_node_named_child_count(self->node)) {
+    Py_RETURN_NONE;
+  }
+  return node_new_internal(ts_node_named_child(self->node, (uint32_t)index), self->tree);
 }
 
 static PyObject *node_get_child_count(Node *self, void *payload) {
@@ -247,61 +1236,81 @@ static PyObject *node_get_parent(Node *self, void *payload) {
   return node_new_internal(parent, self->tree);
 }
 
-// forward declaraction
+static PyObject *tree_get_source_view(Tree *self);
 static PyObject *tree_get_text(Tree *self, void *payload);
 
-static PyObject *node_get_text(Node *self, void *payload) {
-  Tree *tree = (Tree *)self->tree;
-  if (tree == NULL) {
+// Find the node's byte range within its tree's source. Returns 0 on success,
+// 1 if the text is unavailable, and -1 with an exception set on error.
+static int node_text_range(Node *self, Tree **tree, size_t *start, size_t *end) {
+  *tree = (Tree *)self->tree;
+  if (*tree == NULL) {
     PyErr_SetString(PyExc_ValueError, "No tree");
-    return NULL;
-  }
-  PyObject *source = tree_get_text(tree, NULL);
-  if (source == Py_None) {
-    Py_RETURN_NONE;
-  }
-  // "hello"[1:3] == "hello".__getitem__(slice(1, 3))
-  PyObject *start_byte =
-    PyLong_FromSize_t((size_t)ts_node_start_byte(self->node));
-  if (start_byte == NULL) {
-    PyErr_SetString(PyExc_RuntimeError,
-                    "Failed to determine start byte");
-    return NULL;
+    return -1;
   }
-  PyObject *end_byte =
-    PyLong_FromSize_t((size_t)ts_node_end_byte(self->node));
-  if (end_byte == NULL) {
-    Py_DECREF(start_byte);
-    PyErr_SetString(PyExc_RuntimeError,
-                    "Failed to determine end byte");
-    return NULL;
+  if ((*tree)->edited) return 1;
+  if (!(*tree)->text_buffer && ((*tree)->source == NULL || (*tree)->source == Py_None)) {
+    return 1;
   }
-  PyObject *slice = PySlice_New(start_byte, end_byte, NULL);
-  Py_DECREF(start_byte);
-  Py_DECREF(end_byte);
-  if (slice == NULL) {
-    PyErr_SetString(PyExc_RuntimeError,
-                    "PySlice_New failed");
-    return NULL;
+  *start = ts_node_start_byte(self->node);
+  *end = ts_node_end_byte(self->node);
+  if (*end < *start) *end = *start;
+  return 0;
+}
+
+static PyObject *node_get_text_bytes(Node *self, void *payload);
+
+static PyObject *node_get_text_view(Node *self, void *payload) {
+  Tree *tree;
+  size_t start, end;
+  int status = node_text_range(self, &tree, &start, &end);
+  if (status < 0) return NULL;
+  if (status > 0) Py_RETURN_NONE;
+
+  // A view holds a buffer export on the source for as long as it lives, which
+  // stops objects like `bytearray` and `mmap` from resizing or closing. Only
+  // views of `bytes` are shared; the text of other sources is copied. So is
+  // the text of a gap buffer, which would otherwise be copied whole after
+  // every edit to make the shared view.
+  if (tree->text_buffer || !PyBytes_Check(tree->source)) {
+    PyObject *text = node_get_text_bytes(self, NULL);
+    if (text == NULL || text == Py_None) return text;
+    PyObject *view = PyMemoryView_FromObject(text);
+    Py_DECREF(text);
+    return view;
   }
-  PyObject *node_mv = PyMemoryView_FromObject(source);
-  Py_DECREF(source);
-  if (node_mv == NULL) {
-    Py_DECREF(slice);
-    PyErr_SetString(PyExc_RuntimeError,
-                    "PyMemoryView_FromObject failed");
-    return NULL;
+
+  PyObject *view = tree_get_source_view(tree);
+  if (view == NULL) return NULL;
+  if (view == Py_None) Py_RETURN_NONE;
+  return PySequence_GetSlice(view, (Py_ssize_t)start, (Py_ssize_t)end);
+}
+
+static PyObject *node_get_text_bytes(Node *self, void *payload) {
+  Tree *tree;
+  size_t start, end;
+  int status = node_text_range(self, &tree, &start, &end);
+  if (status < 0) return NULL;
+  if (status > 0) Py_RETURN_NONE;
+
+  if (tree->text_buffer) {
+    return text_buffer_get_bytes(tree->text_buffer, start, end);
   }
-  PyObject *node_slice = PyObject_GetItem(node_mv, slice);
-  Py_DECREF(slice);
-  Py_DECREF(node_mv);
-  if (node_slice == NULL) {
-    PyErr_SetString(PyExc_RuntimeError,
-                    "PyObject_GetItem failed");
-    return NULL;
+
+  if (PyBytes_CheckExact(tree->source)) {
+    size_t length = (size_t)PyBytes_GET_SIZE(tree->source);
+    if (end > length) end = length;
+    if (start > end) start = end;
+    return PyBytes_FromStringAndSize(PyBytes_AS_STRING(tree->source) + start, end - start);
   }
-  Py_INCREF(node_slice);
-  return node_slice;
+
+  Py_buffer buffer;
+  if (PyObject_GetBuffer(tree->source, &buffer, PyBUF_SIMPLE) < 0) return NULL;
+  size_t length = (size_t)buffer.len;
+  if (end > length) end = length;
+  if (start > end) start = end;
+  PyObject *result = PyBytes_FromStringAndSize((const char *)buffer.buf + start, end - start);
+  PyBuffer_Release(&buffer);
+  return result;
 }
 
 static PyMethodDef node_methods[] = {
@@ -312,6 +1321,20 @@ static PyMethodDef node_methods[] = {
     .ml_doc = "walk()\n--\n\n\
                Get a tree cursor for walking the tree starting at this node.",
   },
+  {
+    .ml_name = "descendants",
+    .ml_meth = (PyCFunction)node_descendants,
+    .ml_flags = METH_VARARGS|METH_KEYWORDS,
+    .ml_doc = "descendants(order='preorder', named_only=False, types=None,\
+               start_byte=None, end_byte=None, with_info=False)\n--\n\n\
+               Iterate over this node and all of its descendants.\n\n\
+               order is \"preorder\" or \"postorder\". If named_only is true,\n\
+               only named nodes are yielded, and if types is given, only nodes\n\
+               whose type is in it. Subtrees that don't intersect the range\n\
+               from start_byte to end_byte are skipped entirely. If with_info\n\
+               is true, (node, depth, field_name) tuples are yielded instead\n\
+               of nodes.",
+  },
   {
     .ml_name = "sexp",
     .ml_meth = (PyCFunction)node_sexp,
@@ -322,22 +1345,69 @@ static PyMethodDef node_methods[] = {
   {
     .ml_name = "child_by_field_id",
     .ml_meth = (PyCFunction)node_chield_by_field_id,
-    .ml_flags = METH_VARARGS,
+    .ml_flags = METH_O,
     .ml_doc = "child_by_field_id(id)\n--\n\n\
                Get child for the given field id.",
   },
   {
     .ml_name = "child_by_field_name",
     .ml_meth = (PyCFunction)node_chield_by_field_name,
-    .ml_flags = METH_VARARGS,
+    .ml_flags = METH_O,
     .ml_doc = "child_by_field_name(name)\n--\n\n\
                Get child for the given field name.",
   },
+  {
+    .ml_name = "child",
+    .ml_meth = (PyCFunction)node_child,
+    .ml_flags = METH_O,
+    .ml_doc = "child(index)\n--\n\n\
+               Get the child at the given index, or None if there is none.",
+  },
+  {
+    .ml_name = "named_child",
+    .ml_meth = (PyCFunction)node_named_child,
+    .ml_flags = METH_O,
+    .ml_doc = "named_child(index)\n--\n\n\
+               Get the named child at the given index, or None if there is none.",
+  },
+  {
+    .ml_name = "descendant_for_byte_range",
+    .ml_meth = (PyCFunction)node_descendant_for_byte_range,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "descendant_for_byte_range(start_byte, end_byte)\n--\n\n\
+               Get the smallest node within this node that spans the given\n\
+               range of bytes.",
+  },
+  {
+    .ml_name = "named_descendant_for_byte_range",
+    .ml_meth = (PyCFunction)node_named_descendant_for_byte_range,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "named_descendant_for_byte_range(start_byte, end_byte)\n--\n\n\
+               Get the smallest named node within this node that spans the\n\
+               given range of bytes.",
+  },
+  {
+    .ml_name = "descendant_for_point_range",
+    .ml_meth = (PyCFunction)node_descendant_for_point_range,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "descendant_for_point_range(start_point, end_point)\n--\n\n\
+               Get the smallest node within this node that spans the given\n\
+               range of (row, column) points.",
+  },
+  {
+    .ml_name = "named_descendant_for_point_range",
+    .ml_meth = (PyCFunction)node_named_descendant_for_point_range,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "named_descendant_for_point_range(start_point, end_point)\n--\n\n\
+               Get the smallest named node within this node that spans the\n\
+               given range of (row, column) points.",
+  },
   {NULL},
 };
 
 static PyGetSetDef node_accessors[] = {
   {"type", (getter)node_get_type, NULL, "The node's type", NULL},
+  {"symbol", (getter)node_get_symbol, NULL, "The node's numeric symbol id", NULL},
   {"is_named", (getter)node_get_is_named, NULL, "Is this a named node", NULL},
   {"is_missing", (getter)node_get_is_missing, NULL, "Is this a node inserted by the parser", NULL},
   {"has_changes", (getter)node_get_has_changes, NULL, "Does this node have text changes since it was parsed", NULL},
@@ -346,7 +1416,8 @@ static PyGetSetDef node_accessors[] = {
   {"end_byte", (getter)node_get_end_byte, NULL, "The node's end byte", NULL},
   {"start_point", (getter)node_get_start_point, NULL, "The node's start point", NULL},
   {"end_point", (getter)node_get_end_point, NULL, "The node's end point", NULL},
-  {"children", (getter)node_get_children, NULL, "The node's children", NULL},
+  {"children", (getter)node_get_children, NULL, "The node's children, as a sequence", NULL},
+  {"named_children", (getter)node_get_named_children, NULL, "The node's named children, as a sequence", NULL},
   {"child_count", (getter)node_get_child_count, NULL, "The number of children for a node", NULL},
   {"named_child_count", (getter)node_get_named_child_count, NULL, "The number of named children for a node", NULL},
   {"next_sibling", (getter)node_get_next_sibling, NULL, "The node's next sibling", NULL},
@@ -354,10 +1425,25 @@ static PyGetSetDef node_accessors[] = {
   {"next_named_sibling", (getter)node_get_next_named_sibling, NULL, "The node's next named sibling", NULL},
   {"prev_named_sibling", (getter)node_get_prev_named_sibling, NULL, "The node's previous named sibling", NULL},
   {"parent", (getter)node_get_parent, NULL, "The node's parent", NULL},
-  {"text", (getter)node_get_text, NULL, "The node's text, if tree has not been edited", NULL},
+  {"text", (getter)node_get_text_view, NULL, "The node's text, if tree has not been edited", NULL},
+  {"text_bytes", (getter)node_get_text_bytes, NULL, "A copy of the node's text as bytes, if tree has not been edited", NULL},
+  {
+    "text_view",
+    (getter)node_get_text_view,
+    NULL,
+    "A memoryview of the node's text, if tree has not been edited. It shares the memory of a bytes source; the text of other sources is copied.",
+    NULL
+  },
   {NULL}
 };
 
+// Every method and property of a node reads its syntax node, so check the
+// tree once here rather than in each of them.
+static PyObject *node_getattro(Node *self, PyObject *name) {
+  if (!tree_check_open(self->tree)) return NULL;
+  return PyObject_GenericGetAttr((PyObject *)self, name);
+}
+
 static PyTypeObject node_type = {
   PyVarObject_HEAD_INIT(NULL, 0)
   .tp_name = "tree_sitter.Node",
@@ -366,6 +1452,7 @@ static PyTypeObject node_type = {
   .tp_itemsize = 0,
   .tp_flags = Py_TPFLAGS_DEFAULT,
   .tp_dealloc = (destructor)node_dealloc,
+  .tp_getattro = (getattrofunc)node_getattro,
   .tp_repr = (reprfunc)node_repr,
   .tp_richcompare = (richcmpfunc)node_compare,
   .tp_methods = node_methods,
@@ -373,12 +1460,31 @@ static PyTypeObject node_type = {
 };
 
 static PyObject *node_new_internal(TSNode node, PyObject *tree) {
-  Node *self = (Node *)node_type.tp_alloc(&node_type, 0);
+  NodeCache *cache = ((Tree *)tree)->node_cache;
+  if (cache) {
+    Node *existing = node_cache_get(cache, node);
+    if (existing) {
+      Py_INCREF(existing);
+      return (PyObject *)existing;
+    }
+  }
+
+  Node *self;
+#ifndef PYPY_VERSION
+  if (node_free_list_count > 0) {
+    self = node_free_list[--node_free_list_count];
+    PyObject_Init((PyObject *)self, &node_type);
+  } else
+#endif
+  self = (Node *)node_type.tp_alloc(&node_type, 0);
+
   if (self != NULL) {
     self->node = node;
     Py_INCREF(tree);
     self->tree = tree;
     self->children = NULL;
+    self->named_children = NULL;
+    if (cache) node_cache_insert(cache, self);
   }
   return (PyObject *)self;
 }
@@ -387,14 +1493,236 @@ static bool node_is_instance(PyObject *self) {
   return PyObject_IsInstance(self, (PyObject *)&node_type);
 }
 
+// Node children
+
+static void node_children_dealloc(NodeChildren *self) {
+  Py_XDECREF(self->tree);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static Py_ssize_t node_children_length(NodeChildren *self) {
+  if (!tree_check_open(self->tree)) return -1;
+  return self->named
+    ? (Py_ssize_t)ts_node_named_child_count(self->node)
+    : (Py_ssize_t)ts_node_child_count(self->node);
+}
+
+static PyObject *node_children_item(NodeChildren *self, Py_ssize_t index) {
+  if (!tree_check_open(self->tree)) return NULL;
+  if (index < 0 || index >= node_children_length(self)) {
+    PyErr_SetString(PyExc_IndexError, "Child index out of range");
+    return NULL;
+  }
+  TSNode child = self->named
+    ? ts_node_named_child(self->node, (uint32_t)index)
+    : ts_node_child(self->node, (uint32_t)index);
+  return node_new_internal(child, self->tree);
+}
+
+static PyObject *node_children_iter(NodeChildren *self);
+
+// Build a list of all the children, walking them with a cursor rather than
+// looking each one up by index.
+static PyObject *node_children_to_list(NodeChildren *self) {
+  PyObject *iterator = node_children_iter(self);
+  if (iterator == NULL) return NULL;
+  PyObject *result = PySequence_List(iterator);
+  Py_DECREF(iterator);
+  return result;
+}
+
+static PyObject *node_children_subscript(NodeChildren *self, PyObject *key) {
+  if (PySlice_Check(key)) {
+    PyObject *list = node_children_to_list(self);
+    if (list == NULL) return NULL;
+    PyObject *result = PyObject_GetItem(list, key);
+    Py_DECREF(list);
+    return result;
+  }
+  Py_ssize_t index = PyNumber_AsSsize_t(key, PyExc_IndexError);
+  if (index == -1 && PyErr_Occurred()) return NULL;
+  if (index < 0) {
+    Py_ssize_t length = node_children_length(self);
+    if (length < 0) return NULL;
+    index += length;
+  }
+  return node_children_item(self, index);
+}
+
+static PyObject *node_children_compare(NodeChildren *self, PyObject *other, int op) {
+  if (op != Py_EQ && op != Py_NE) {
+    Py_RETURN_NOTIMPLEMENTED;
+  }
+  PyObject *other_list;
+  if (PyObject_TypeCheck(other, Py_TYPE(self))) {
+    other_list = node_children_to_list((NodeChildren *)other);
+  } else if (PyList_Check(other)) {
+    Py_INCREF(other);
+    other_list = other;
+  } else {
+    Py_RETURN_NOTIMPLEMENTED;
+  }
+  if (other_list == NULL) return NULL;
+  PyObject *list = node_children_to_list(self);
+  PyObject *result = list ? PyObject_RichCompare(list, other_list, op) : NULL;
+  Py_XDECREF(list);
+  Py_DECREF(other_list);
+  return result;
+}
+
+static PyObject *node_children_repr(NodeChildren *self) {
+  if (!((Tree *)self->tree)->tree) return PyUnicode_FromString("<NodeChildren of a closed tree>");
+  PyObject *list = node_children_to_list(self);
+  if (list == NULL) return NULL;
+  PyObject *result = PyObject_Repr(list);
+  Py_DECREF(list);
+  return result;
+}
+
+static PySequenceMethods node_children_sequence_methods = {
+  .sq_length = (lenfunc)node_children_length,
+  .sq_item = (ssizeargfunc)node_children_item,
+};
+
+static PyMappingMethods node_children_mapping_methods = {
+  .mp_length = (lenfunc)node_children_length,
+  .mp_subscript = (binaryfunc)node_children_subscript,
+};
+
+static PyTypeObject node_children_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.NodeChildren",
+  .tp_doc = "The children of a syntax node",
+  .tp_basicsize = sizeof(NodeChildren),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor)node_children_dealloc,
+  .tp_repr = (reprfunc)node_children_repr,
+  .tp_as_sequence = &node_children_sequence_methods,
+  .tp_as_mapping = &node_children_mapping_methods,
+  .tp_hash = PyObject_HashNotImplemented,
+  .tp_richcompare = (richcmpfunc)node_children_compare,
+  .tp_iter = (getiterfunc)node_children_iter,
+};
+
+static PyObject *node_children_new_internal(TSNode node, PyObject *tree, bool named) {
+  NodeChildren *self = (NodeChildren *)node_children_type.tp_alloc(&node_children_type, 0);
+  if (self == NULL) return NULL;
+  self->node = node;
+  Py_INCREF(tree);
+  self->tree = tree;
+  self->named = named;
+  return (PyObject *)self;
+}
+
+static void node_children_iterator_dealloc(NodeChildrenIterator *self) {
+  ts_tree_cursor_delete(&self->cursor);
+  Py_XDECREF(self->tree);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *node_children_iterator_next(NodeChildrenIterator *self) {
+  if (!self->done && !tree_check_open(self->tree)) return NULL;
+  while (!self->done) {
+    bool moved = self->started
+      ? ts_tree_cursor_goto_next_sibling(&self->cursor)
+      : ts_tree_cursor_goto_first_child(&self->cursor);
+    self->started = true;
+    if (!moved) {
+      self->done = true;
+      break;
+    }
+    TSNode child = ts_tree_cursor_current_node(&self->cursor);
+    if (!self->named || ts_node_is_named(child)) {
+      return node_new_internal(child, self->tree);
+    }
+  }
+  return NULL;
+}
+
+static PyTypeObject node_children_iterator_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.NodeChildrenIterator",
+  .tp_doc = "An iterator over the children of a syntax node",
+  .tp_basicsize = sizeof(NodeChildrenIterator),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor)node_children_iterator_dealloc,
+  .tp_iter = PyObject_SelfIter,
+  .tp_iternext = (iternextfunc)node_children_iterator_next,
+};
+
+static PyObject *node_children_iter(NodeChildren *self) {
+  if (!tree_check_open(self->tree)) return NULL;
+  NodeChildrenIterator *iterator = (NodeChildrenIterator *)node_children_iterator_type.tp_alloc(
+    &node_children_iterator_type, 0
+  );
+  if (iterator == NULL) return NULL;
+  iterator->cursor = ts_tree_cursor_new(self->node);
+  Py_INCREF(self->tree);
+  iterator->tree = self->tree;
+  iterator->named = self->named;
+  iterator->started = false;
+  iterator->done = false;
+  return (PyObject *)iterator;
+}
+
 // Tree
 
 static void tree_dealloc(Tree *self) {
-  ts_tree_delete(self->tree);
+  node_cache_delete(self->node_cache);
+  if (self->cursor) {
+    ts_tree_cursor_delete(self->cursor);
+    PyMem_Free(self->cursor);
+  }
+  if (self->tree) ts_tree_delete(self->tree);
+  text_buffer_delete(self->text_buffer);
+  Py_XDECREF(self->source_view);
   Py_XDECREF(self->source);
+  Py_XDECREF(self->included_ranges);
   Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
+// A single memoryview over the source is created on first use and shared by
+// all of the tree's nodes. Returns a borrowed reference.
+static PyObject *tree_get_source_view(Tree *self) {
+  if (self->source_view == NULL) {
+    PyObject *source = tree_get_text(self, NULL);
+    if (source == NULL) return NULL;
+    if (source == Py_None) {
+      Py_DECREF(source);
+      return Py_None;
+    }
+    self->source_view = PyMemoryView_FromObject(source);
+    Py_DECREF(source);
+  }
+  return self->source_view;
+}
+
+// The tree keeps one spare cursor for internal walks such as exporting
+// arrays. A caller takes it (or a fresh one, if it is already in
+// use) and hands it back when done, so walks never share cursor state.
+static TSTreeCursor *tree_take_cursor(Tree *self, TSNode node) {
+  TSTreeCursor *cursor = self->cursor;
+  if (cursor) {
+    self->cursor = NULL;
+    ts_tree_cursor_reset(cursor, node);
+    return cursor;
+  }
+  cursor = PyMem_Malloc(sizeof(TSTreeCursor));
+  if (cursor) *cursor = ts_tree_cursor_new(node);
+  return cursor;
+}
+
+static void tree_give_cursor(Tree *self, TSTreeCursor *cursor) {
+  if (self->cursor) {
+    ts_tree_cursor_delete(cursor);
+    PyMem_Free(cursor);
+  } else {
+    self->cursor = cursor;
+  }
+}
+
 static PyObject *tree_get_root_node(Tree *self, void *payload) {
   return node_new_internal(ts_tree_root_node(self->tree), (PyObject *)self);
 }
@@ -403,6 +1731,12 @@ static PyObject *tree_get_text(Tree *self, void *payload) {
   if (self->edited) {
     Py_RETURN_NONE;
   }
+  // After edits with replacement text, the source is materialized as bytes
+  // on demand and kept until the next edit.
+  if (self->text_buffer && self->source == NULL) {
+    self->source = text_buffer_get_bytes(self->text_buffer, 0, self->text_buffer->length);
+    if (self->source == NULL) return NULL;
+  }
   PyObject *source = self->source;
   if (source == NULL) {
     Py_RETURN_NONE;
@@ -411,103 +1745,771 @@ static PyObject *tree_get_text(Tree *self, void *payload) {
   return source;
 }
 
+static PyObject *tree_get_included_ranges(Tree *self, void *payload) {
+  if (self->included_ranges) return PySequence_List(self->included_ranges);
+  TSRange whole_document = {
+    .start_point = {0, 0},
+    .end_point = {UINT32_MAX, UINT32_MAX},
+    .start_byte = 0,
+    .end_byte = UINT32_MAX,
+  };
+  PyObject *range = range_new_internal(whole_document);
+  if (range == NULL) return NULL;
+  PyObject *result = PyList_New(1);
+  if (result == NULL) {
+    Py_DECREF(range);
+    return NULL;
+  }
+  PyList_SET_ITEM(result, 0, range);
+  return result;
+}
+
 static PyObject *tree_walk(Tree *self, PyObject *args) {
   return tree_cursor_new_internal(ts_tree_root_node(self->tree), (PyObject *)self);
 }
 
-static PyObject *tree_edit(Tree *self, PyObject *args, PyObject *kwargs) {
-  unsigned start_byte, start_row, start_column;
-  unsigned old_end_byte, old_end_row, old_end_column;
-  unsigned new_end_byte, new_end_row, new_end_column;
+static PyObject *tree_walk_order(Tree *self, PyObject *args, PyObject *kwargs, const char *order) {
+  if (PyTuple_GET_SIZE(args) > 0) {
+    PyErr_SetString(PyExc_TypeError, "Expected keyword arguments only");
+    return NULL;
+  }
+  PyObject *order_args = Py_BuildValue("(s)", order);
+  if (order_args == NULL) return NULL;
+  PyObject *result = node_iterator_new_internal(
+    ts_tree_root_node(self->tree), (PyObject *)self, order_args, kwargs
+  );
+  Py_DECREF(order_args);
+  return result;
+}
+
+static PyObject *tree_walk_preorder(Tree *self, PyObject *args, PyObject *kwargs) {
+  return tree_walk_order(self, args, kwargs, "preorder");
+}
 
-  char *keywords[] = {
+static PyObject *tree_walk_postorder(Tree *self, PyObject *args, PyObject *kwargs) {
+  return tree_walk_order(self, args, kwargs, "postorder");
+}
+
+// Apply an edit to the tree's copy of its source. The first edit moves the
+// source into a gap buffer, after which the original source object is no
+// longer referenced.
+static int tree_edit_text(Tree *self, const TSInputEdit *edit, Py_buffer *new_text) {
+  if (self->edited) {
+    PyErr_SetString(PyExc_ValueError, "Tree text was already invalidated by an edit without new_text");
+    return -1;
+  }
+  if (!self->text_buffer) {
+    if (self->source == NULL || self->source == Py_None) {
+      PyErr_SetString(PyExc_ValueError, "Tree has no source text to edit");
+      return -1;
+    }
+    Py_buffer source;
+    if (PyObject_GetBuffer(self->source, &source, PyBUF_SIMPLE) < 0) return -1;
+    self->text_buffer = text_buffer_new(source.buf, (size_t)source.len);
+    PyBuffer_Release(&source);
+    if (!self->text_buffer) {
+      PyErr_NoMemory();
+      return -1;
+    }
+  }
+
+  TextBuffer *buffer = self->text_buffer;
+  if (
+    edit->start_byte > edit->old_end_byte ||
+    edit->old_end_byte > buffer->length ||
+    (size_t)edit->new_end_byte - edit->start_byte != (size_t)new_text->len ||
+    edit->new_end_byte < edit->start_byte
+  ) {
+    PyErr_SetString(PyExc_ValueError, "Edit does not match the tree's text and new_text");
+    return -1;
+  }
+
+  if (text_buffer_replace(buffer, edit->start_byte, edit->old_end_byte, new_text->buf, new_text->len) < 0) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  Py_CLEAR(self->source_view);
+  Py_CLEAR(self->source);
+  return 0;
+}
+
+// A parse reads its old tree with the GIL released, and calls its read
+// callback in the middle, so the tree can't change until it finishes.
+static bool tree_check_not_in_use(Tree *self) {
+  if (self->in_use == 0) return true;
+  PyErr_SetString(PyExc_RuntimeError, "Tree is in use by a parse");
+  return false;
+}
+
+static PyObject *tree_edit(Tree *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  static const char *const keywords[] = {
     "start_byte",
     "old_end_byte",
     "new_end_byte",
     "start_point",
     "old_end_point",
     "new_end_point",
+    "new_text",
     NULL,
   };
+  PyObject *values[7] = {NULL};
+  TSInputEdit edit;
+  if (!tree_check_not_in_use(self)) return NULL;
+  if (
+    parse_fastcall_args("edit", args, nargs, kwnames, keywords, 6, values) < 0 ||
+    uint32_from_arg(values[0], &edit.start_byte) < 0 ||
+    uint32_from_arg(values[1], &edit.old_end_byte) < 0 ||
+    uint32_from_arg(values[2], &edit.new_end_byte) < 0 ||
+    point_parse(values[3], &edit.start_point) < 0 ||
+    point_parse(values[4], &edit.old_end_point) < 0 ||
+    point_parse(values[5], &edit.new_end_point) < 0
+  ) {
+    return NULL;
+  }
 
-  int ok = PyArg_ParseTupleAndKeywords(
-    args,
-    kwargs,
-    "III(II)(II)(II)",
-    keywords,
-    &start_byte,
-    &old_end_byte,
-    &new_end_byte,
-    &start_row,
-    &start_column,
-    &old_end_row,
-    &old_end_column,
-    &new_end_row,
-    &new_end_column
-  );
+  Py_buffer new_text = {0};
+  PyObject *new_text_arg = values[6];
+  if (new_text_arg && PyUnicode_Check(new_text_arg)) {
+    Py_ssize_t length;
+    const char *text = PyUnicode_AsUTF8AndSize(new_text_arg, &length);
+    if (text == NULL) return NULL;
+    if (PyBuffer_FillInfo(&new_text, new_text_arg, (void *)text, length, 1, PyBUF_SIMPLE) < 0) {
+      return NULL;
+    }
+  } else if (new_text_arg && new_text_arg != Py_None) {
+    if (PyObject_GetBuffer(new_text_arg, &new_text, PyBUF_SIMPLE) < 0) return NULL;
+  }
 
-  if (ok) {
-    TSInputEdit edit = {
-      .start_byte = start_byte,
-      .old_end_byte = old_end_byte,
-      .new_end_byte = new_end_byte,
-      .start_point = {start_row, start_column},
-      .old_end_point = {old_end_row, old_end_column},
-      .new_end_point = {new_end_row, new_end_column},
-    };
-    ts_tree_edit(self->tree, &edit);
+  if (new_text.buf) {
+    int status = tree_edit_text(self, &edit, &new_text);
+    PyBuffer_Release(&new_text);
+    if (status < 0) return NULL;
+  } else {
+    text_buffer_delete(self->text_buffer);
+    self->text_buffer = NULL;
     self->edited = 1;
   }
+
+  ts_tree_edit(self->tree, &edit);
+
+  // Interned nodes still have their pre-edit positions, so start over.
+  if (self->node_cache) {
+    node_cache_delete(self->node_cache);
+    self->node_cache = node_cache_new();
+  }
   Py_RETURN_NONE;
 }
 
-static PyMethodDef tree_methods[] = {
-  {
-    .ml_name = "walk",
-    .ml_meth = (PyCFunction)tree_walk,
-    .ml_flags = METH_NOARGS,
-    .ml_doc = "walk()\n--\n\n\
-               Get a tree cursor for walking this tree.",
-  },
-  {
-    .ml_name = "edit",
-    .ml_meth = (PyCFunction)tree_edit,
-    .ml_flags = METH_KEYWORDS|METH_VARARGS,
-    .ml_doc = "edit(start_byte, old_end_byte, new_end_byte,\
-               start_point, old_end_point, new_end_point)\n--\n\n\
-               Edit the syntax tree.",
-  },
-  {NULL},
-};
+static bool tree_is_instance(PyObject *self);
 
-static PyGetSetDef tree_accessors[] = {
-  {"root_node", (getter)tree_get_root_node, NULL, "The root node of this tree.", NULL},
-  {"text", (getter)tree_get_text, NULL, "The source text for this tree, if unedited.", NULL},
-  {NULL}
-};
+static PyObject *tree_changed_ranges(Tree *self, PyObject *args, PyObject *kwargs) {
+  char *keywords[] = {"new_tree", NULL};
+  PyObject *new_tree_arg;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", keywords, &new_tree_arg)) {
+    return NULL;
+  }
+  if (!tree_is_instance(new_tree_arg)) {
+    PyErr_SetString(PyExc_TypeError, "First argument to changed_ranges must be a Tree");
+    return NULL;
+  }
+  if (!tree_check_open(new_tree_arg)) return NULL;
 
-static PyTypeObject tree_type = {
-  PyVarObject_HEAD_INIT(NULL, 0)
-  .tp_name = "tree_sitter.Tree",
-  .tp_doc = "A Syntax Tree",
-  .tp_basicsize = sizeof(Tree),
-  .tp_itemsize = 0,
-  .tp_flags = Py_TPFLAGS_DEFAULT,
-  .tp_dealloc = (destructor)tree_dealloc,
-  .tp_methods = tree_methods,
-  .tp_getset = tree_accessors,
-};
+  uint32_t length = 0;
+  TSRange *ranges = ts_tree_get_changed_ranges(self->tree, ((Tree *)new_tree_arg)->tree, &length);
 
-static PyObject *tree_new_internal(TSTree *tree, PyObject *source) {
-  Tree *self = (Tree *)tree_type.tp_alloc(&tree_type, 0);
-  if (self != NULL) self->tree = tree;
+  PyObject *result = PyList_New(length);
+  if (result == NULL) {
+    core_free(ranges);
+    return NULL;
+  }
+  for (uint32_t i = 0; i < length; i++) {
+    PyObject *range = range_new_internal(ranges[i]);
+    if (range == NULL) {
+      Py_CLEAR(result);
+      break;
+    }
+    PyList_SET_ITEM(result, i, range);
+  }
+  core_free(ranges);
+  return result;
+}
 
+typedef struct {
+  int32_t parent;
+  uint32_t depth;
+} TreeArraysAncestor;
+
+// Walk the tree in preorder, counting the nodes to export, and filling in the
+// columns when they are given.
+static int tree_to_arrays_walk(
+  Tree *self,
+  bool named_only,
+  Py_ssize_t *count,
+  int32_t *parents,
+  uint16_t *symbols,
+  uint16_t *field_ids,
+  uint32_t *depths,
+  uint32_t *start_bytes,
+  uint32_t *end_bytes
+) {
+  // `ancestors[d]` describes the exported parent of a node at cursor depth
+  // `d`, which differs from its actual parent when anonymous nodes are skipped.
+  size_t capacity = 64;
+  TreeArraysAncestor *ancestors = PyMem_Malloc(capacity * sizeof(TreeArraysAncestor));
+  if (ancestors == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  ancestors[0].parent = -1;
+  ancestors[0].depth = 0;
+
+  TSTreeCursor *cursor = tree_take_cursor(self, ts_tree_root_node(self->tree));
+  if (cursor == NULL) {
+    PyMem_Free(ancestors);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  Py_ssize_t index = 0;
+  size_t depth = 0;
+  for (;;) {
+    TSNode node = ts_tree_cursor_current_node(cursor);
+    if (depth + 1 >= capacity) {
+      capacity *= 2;
+      TreeArraysAncestor *new_ancestors = PyMem_Realloc(ancestors, capacity * sizeof(TreeArraysAncestor));
+      if (new_ancestors == NULL) {
+        PyMem_Free(ancestors);
+        tree_give_cursor(self, cursor);
+        PyErr_NoMemory();
+        return -1;
+      }
+      ancestors = new_ancestors;
+    }
+
+    if (!named_only || ts_node_is_named(node)) {
+      if (parents) {
+        parents[index] = ancestors[depth].parent;
+        symbols[index] = ts_node_symbol(node);
+        field_ids[index] = ts_tree_cursor_current_field_id(cursor);
+        depths[index] = ancestors[depth].depth;
+        start_bytes[index] = ts_node_start_byte(node);
+        end_bytes[index] = ts_node_end_byte(node);
+      }
+      ancestors[depth + 1].parent = (int32_t)index;
+      ancestors[depth + 1].depth = ancestors[depth].depth + 1;
+      index++;
+    } else {
+      ancestors[depth + 1] = ancestors[depth];
+    }
+
+    if (ts_tree_cursor_goto_first_child(cursor)) {
+      depth++;
+      continue;
+    }
+    while (depth > 0 && !ts_tree_cursor_goto_next_sibling(cursor)) {
+      ts_tree_cursor_goto_parent(cursor);
+      depth--;
+    }
+    if (depth == 0) break;
+  }
+
+  tree_give_cursor(self, cursor);
+  PyMem_Free(ancestors);
+  *count = index;
+  return 0;
+}
+
+static PyObject *tree_to_arrays(Tree *self, PyObject *args, PyObject *kwargs) {
+  char *keywords[] = {"named_only", NULL};
+  int named_only = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", keywords, &named_only)) return NULL;
+
+  Py_ssize_t count;
+  if (tree_to_arrays_walk(self, named_only, &count, NULL, NULL, NULL, NULL, NULL, NULL) < 0) {
+    return NULL;
+  }
+
+  const char *names[] = {"parent", "symbol", "field_id", "depth", "start_byte", "end_byte"};
+  const char *formats[] = {"i", "H", "H", "I", "I", "I"};
+  size_t sizes[] = {
+    sizeof(int32_t),
+    sizeof(uint16_t),
+    sizeof(uint16_t),
+    sizeof(uint32_t),
+    sizeof(uint32_t),
+    sizeof(uint32_t),
+  };
+  PyObject *columns[6] = {NULL};
+  void *data[6];
+  for (int i = 0; i < 6; i++) {
+    columns[i] = column_new(count, sizes[i], &data[i]);
+    if (columns[i] == NULL) goto error;
+  }
+
+  if (tree_to_arrays_walk(
+    self, named_only, &count,
+    data[0], data[1], data[2], data[3], data[4], data[5]
+  ) < 0) goto error;
+
+  PyObject *result = PyDict_New();
+  if (result == NULL) goto error;
+  for (int i = 0; i < 6; i++) {
+    PyObject *view = column_view(columns[i], formats[i]);
+    columns[i] = NULL;
+    if (view == NULL || PyDict_SetItemString(result, names[i], view) < 0) {
+      Py_XDECREF(view);
+      Py_DECREF(result);
+      goto error;
+    }
+    Py_DECREF(view);
+  }
+  return result;
+
+error:
+  for (int i = 0; i < 6; i++) Py_XDECREF(columns[i]);
+  return NULL;
+}
+
+static PyObject *tree_new_internal(TSTree *tree, PyObject *source);
+
+// `ts_tree_copy` only increments a reference count, so copies are cheap. The
+// copy has its own gap buffer, since edits with new text modify it in place.
+static PyObject *tree_copy(Tree *self, PyObject *args) {
+  if (!tree_check_open((PyObject *)self)) return NULL;
+  TextBuffer *text_buffer = NULL;
+  if (self->text_buffer) {
+    text_buffer = text_buffer_clone(self->text_buffer);
+    if (text_buffer == NULL) return PyErr_NoMemory();
+  }
+
+  Tree *result = (Tree *)tree_new_internal(ts_tree_copy(self->tree), self->source);
+  if (result == NULL) {
+    text_buffer_delete(text_buffer);
+    return NULL;
+  }
+  result->edited = self->edited;
+  result->text_buffer = text_buffer;
+  result->native_bytes = self->native_bytes;
+  result->cache_children = self->cache_children;
+  result->included_ranges = self->included_ranges;
+  Py_XINCREF(result->included_ranges);
+  if (self->node_cache) {
+    result->node_cache = node_cache_new();
+    if (result->node_cache == NULL) {
+      Py_DECREF(result);
+      return PyErr_NoMemory();
+    }
+  }
+  return (PyObject *)result;
+}
+
+// Free the syntax tree and the source right away, rather than when the last
+// node referring to them is garbage collected.
+static PyObject *tree_close(Tree *self, PyObject *args) {
+  if (!self->tree) Py_RETURN_NONE;
+  if (!tree_check_not_in_use(self)) return NULL;
+  node_cache_delete(self->node_cache);
+  self->node_cache = NULL;
+  if (self->cursor) {
+    ts_tree_cursor_delete(self->cursor);
+    PyMem_Free(self->cursor);
+    self->cursor = NULL;
+  }
+  ts_tree_delete(self->tree);
+  self->tree = NULL;
+  text_buffer_delete(self->text_buffer);
+  self->text_buffer = NULL;
+  self->native_bytes = 0;
+  Py_CLEAR(self->source_view);
+  Py_CLEAR(self->source);
+  Py_RETURN_NONE;
+}
+
+static PyObject *tree_enter(Tree *self, PyObject *args) {
+  Py_INCREF(self);
+  return (PyObject *)self;
+}
+
+static PyObject *tree_exit(Tree *self, PyObject *args) {
+  return tree_close(self, NULL);
+}
+
+static PyObject *tree_memory_usage(Tree *self, PyObject *args) {
+  size_t source_bytes = 0;
+  if (self->text_buffer) {
+    source_bytes = self->text_buffer->length + self->text_buffer->gap_size;
+  } else if (self->source && self->source != Py_None) {
+    // The length of a sequence isn't always its size in bytes, as for an
+    // array of wide items, so measure the buffer.
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(self->source, &buffer, PyBUF_SIMPLE) < 0) {
+      PyErr_Clear();
+    } else {
+      source_bytes = (size_t)buffer.len;
+      PyBuffer_Release(&buffer);
+    }
+  }
+
+  size_t wrapper_bytes = (size_t)Py_TYPE(self)->tp_basicsize;
+  if (self->cursor) wrapper_bytes += sizeof(TSTreeCursor);
+  if (self->source_view) wrapper_bytes += (size_t)Py_TYPE(self->source_view)->tp_basicsize;
+  if (self->node_cache) {
+    wrapper_bytes += sizeof(NodeCache) + self->node_cache->capacity * sizeof(Node *);
+    wrapper_bytes += self->node_cache->count * (size_t)node_type.tp_basicsize;
+  }
+
+  return Py_BuildValue(
+    "{snsnsnsn}",
+    "tree", (Py_ssize_t)self->native_bytes,
+    "source", (Py_ssize_t)source_bytes,
+    "wrappers", (Py_ssize_t)wrapper_bytes,
+    "total", (Py_ssize_t)(self->native_bytes + source_bytes + wrapper_bytes)
+  );
+}
+
+static PyMethodDef tree_methods[] = {
+  {
+    .ml_name = "close",
+    .ml_meth = (PyCFunction)tree_close,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "close()\n--\n\n\
+               Free this tree's syntax nodes and source text now. Afterwards,\n\
+               using the tree or any of its nodes, cursors or children raises\n\
+               ValueError. Closing a tree while a parse uses it as its old tree\n\
+               raises RuntimeError.",
+  },
+  {
+    .ml_name = "__enter__",
+    .ml_meth = (PyCFunction)tree_enter,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "__enter__()\n--\n\n\
+               Use the tree in a with block, which closes it at the end.",
+  },
+  {
+    .ml_name = "__exit__",
+    .ml_meth = (PyCFunction)tree_exit,
+    .ml_flags = METH_VARARGS,
+    .ml_doc = "__exit__(*exc_info)\n--\n\n\
+               Close the tree.",
+  },
+  {
+    .ml_name = "memory_usage",
+    .ml_meth = (PyCFunction)tree_memory_usage,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "memory_usage()\n--\n\n\
+               Get the bytes used by this tree, as a dict with the native\n\
+               memory allocated while parsing it ('tree'), its source text\n\
+               ('source'), the binding's own objects ('wrappers') and the\n\
+               'total'. Native memory may be shared with copies of the tree and\n\
+               with trees parsed incrementally from it.",
+  },
+  {
+    .ml_name = "copy",
+    .ml_meth = (PyCFunction)tree_copy,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "copy()\n--\n\n\
+               Create a copy of this tree, which can be edited independently.\n\n\
+               This is cheap: the copy shares the tree's immutable structure.",
+  },
+  {
+    .ml_name = "__copy__",
+    .ml_meth = (PyCFunction)tree_copy,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "__copy__()\n--\n\n\
+               Create a copy of this tree.",
+  },
+  {
+    .ml_name = "__deepcopy__",
+    .ml_meth = (PyCFunction)tree_copy,
+    .ml_flags = METH_O,
+    .ml_doc = "__deepcopy__(memo)\n--\n\n\
+               Create a copy of this tree.",
+  },
+  {
+    .ml_name = "walk",
+    .ml_meth = (PyCFunction)tree_walk,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "walk()\n--\n\n\
+               Get a tree cursor for walking this tree.",
+  },
+  {
+    .ml_name = "to_arrays",
+    .ml_meth = (PyCFunction)tree_to_arrays,
+    .ml_flags = METH_VARARGS|METH_KEYWORDS,
+    .ml_doc = "to_arrays(named_only=False)\n--\n\n\
+               Export the tree's nodes in preorder as a dict of parallel arrays:\n\
+               parent (the index of each node's parent, or -1 for the root),\n\
+               symbol, field_id (0 for none), depth, start_byte and end_byte.\n\
+               Each array is a typed memoryview. If named_only is true, only\n\
+               named nodes are exported, and parents and depths skip over\n\
+               anonymous nodes.",
+  },
+  {
+    .ml_name = "walk_preorder",
+    .ml_meth = (PyCFunction)tree_walk_preorder,
+    .ml_flags = METH_VARARGS|METH_KEYWORDS,
+    .ml_doc = "walk_preorder(named_only=False, types=None,\
+               start_byte=None, end_byte=None, with_info=False)\n--\n\n\
+               Iterate over all of the nodes in this tree in preorder.\n\n\
+               See Node.descendants for the arguments.",
+  },
+  {
+    .ml_name = "walk_postorder",
+    .ml_meth = (PyCFunction)tree_walk_postorder,
+    .ml_flags = METH_VARARGS|METH_KEYWORDS,
+    .ml_doc = "walk_postorder(named_only=False, types=None,\
+               start_byte=None, end_byte=None, with_info=False)\n--\n\n\
+               Iterate over all of the nodes in this tree in postorder.\n\n\
+               See Node.descendants for the arguments.",
+  },
+  {
+    .ml_name = "edit",
+    .ml_meth = (PyCFunction)tree_edit,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "edit(start_byte, old_end_byte, new_end_byte,\
+               start_point, old_end_point, new_end_point, new_text=None)\n--\n\n\
+               Edit the syntax tree.\n\n\
+               If new_text is given, it replaces the edited range in the tree's\n\
+               copy of the source, so the text stays available after the edit.\n\
+               Otherwise the tree's text becomes unavailable.",
+  },
+  {
+    .ml_name = "changed_ranges",
+    .ml_meth = (PyCFunction)tree_changed_ranges,
+    .ml_flags = METH_VARARGS|METH_KEYWORDS,
+    .ml_doc = "changed_ranges(new_tree)\n--\n\n\
+               Compare this old edited tree to a new tree parsed from the same\n\
+               document, and return a list of the ranges whose syntactic\n\
+               structure has changed.",
+  },
+  {NULL},
+};
+
+static PyObject *tree_get_intern_nodes(Tree *self, void *payload) {
+  return PyBool_FromLong(self->node_cache != NULL);
+}
+
+static PyObject *tree_get_closed(Tree *self, void *payload) {
+  return PyBool_FromLong(self->tree == NULL);
+}
+
+static PyObject *tree_get_cache_children(Tree *self, void *payload) {
+  return PyBool_FromLong(self->cache_children);
+}
+
+static int tree_set_cache_children(Tree *self, PyObject *value, void *payload) {
+  if (value == NULL) {
+    PyErr_SetString(PyExc_AttributeError, "Cannot delete cache_children");
+    return -1;
+  }
+  int enabled = PyObject_IsTrue(value);
+  if (enabled < 0) return -1;
+  self->cache_children = enabled;
+  return 0;
+}
+
+static int tree_set_intern_nodes(Tree *self, PyObject *value, void *payload) {
+  if (value == NULL) {
+    PyErr_SetString(PyExc_AttributeError, "Cannot delete intern_nodes");
+    return -1;
+  }
+  int enabled = PyObject_IsTrue(value);
+  if (enabled < 0) return -1;
+  if (enabled && !self->node_cache) {
+    self->node_cache = node_cache_new();
+    if (!self->node_cache) {
+      PyErr_NoMemory();
+      return -1;
+    }
+  } else if (!enabled && self->node_cache) {
+    node_cache_delete(self->node_cache);
+    self->node_cache = NULL;
+  }
+  return 0;
+}
+
+static PyGetSetDef tree_accessors[] = {
+  {"root_node", (getter)tree_get_root_node, NULL, "The root node of this tree.", NULL},
+  {"text", (getter)tree_get_text, NULL, "The source text for this tree, if unedited or edited with new_text.", NULL},
+  {
+    "intern_nodes",
+    (getter)tree_get_intern_nodes,
+    (setter)tree_set_intern_nodes,
+    "Whether accessing the same syntax node repeatedly returns the same Node object.",
+    NULL
+  },
+  {
+    "cache_children",
+    (getter)tree_get_cache_children,
+    (setter)tree_set_cache_children,
+    "Whether nodes keep the sequences returned by children and named_children for reuse.",
+    NULL
+  },
+  {
+    "included_ranges",
+    (getter)tree_get_included_ranges,
+    NULL,
+    "The included ranges of the parser when it parsed this tree.",
+    NULL
+  },
+  {"closed", (getter)tree_get_closed, NULL, "Whether close has been called on this tree.", NULL},
+  {NULL}
+};
+
+// The attributes that can still be used once a tree is closed. Everything
+// else reads the syntax tree.
+static const char *const tree_closed_attributes[] = {
+  "__class__",
+  "__enter__",
+  "__exit__",
+  "cache_children",
+  "close",
+  "closed",
+  "intern_nodes",
+  "memory_usage",
+  NULL,
+};
+
+static PyObject *tree_getattro(Tree *self, PyObject *name) {
+  if (!self->tree && PyUnicode_Check(name)) {
+    const char *const *attribute = tree_closed_attributes;
+    while (*attribute && PyUnicode_CompareWithASCIIString(name, *attribute) != 0) attribute++;
+    if (!*attribute) {
+      tree_check_open((PyObject *)self);
+      return NULL;
+    }
+  }
+  return PyObject_GenericGetAttr((PyObject *)self, name);
+}
+
+static PyTypeObject tree_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.Tree",
+  .tp_doc = "A Syntax Tree\n\n\
+Trees can be pickled. A pickle holds the tree's language, source text and\n\
+included ranges, and loading it parses the text again, so a tree that was\n\
+edited without new_text can't be pickled until it is reparsed.",
+  .tp_basicsize = sizeof(Tree),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor)tree_dealloc,
+  .tp_getattro = (getattrofunc)tree_getattro,
+  .tp_methods = tree_methods,
+  .tp_getset = tree_accessors,
+};
+
+static PyObject *tree_new_internal(TSTree *tree, PyObject *source) {
+  Tree *self = (Tree *)tree_type.tp_alloc(&tree_type, 0);
+  if (self == NULL) {
+    ts_tree_delete(tree);
+    return NULL;
+  }
+
+  self->tree = tree;
   self->edited = 0;
+  self->cursor = NULL;
+  self->source_view = NULL;
+  self->text_buffer = NULL;
+  self->node_cache = NULL;
+  self->native_bytes = 0;
+  self->cache_children = true;
+  self->included_ranges = NULL;
+  self->in_use = 0;
   self->source = source;
-  Py_INCREF(self->source);
+  Py_XINCREF(self->source);
   return (PyObject *)self;
 }
 
+static bool tree_is_instance(PyObject *self) {
+  return PyObject_IsInstance(self, (PyObject *)&tree_type);
+}
+
+// Read-only access to a tree's source text from native code.
+typedef struct {
+  const char *data;
+  size_t length;
+  // The gap buffer holding the text, if the tree was edited with new text.
+  // Its gap stays where it is: nodes on either side of it are read in place,
+  // and only the text of a node that spans the gap is copied, into one of two
+  // scratch buffers so that two nodes can be compared.
+  TextBuffer *text_buffer;
+  char *scratch[2];
+  size_t scratch_capacity[2];
+  Py_buffer buffer;
+  bool has_buffer;
+} TreeText;
+
+// Returns 1 when the text is available, 0 when it is not, and -1 on error.
+// The text must be released before control returns to Python code, which
+// could edit the tree or its source.
+static int tree_text_acquire(Tree *self, TreeText *text) {
+  text->has_buffer = false;
+  text->text_buffer = NULL;
+  for (int i = 0; i < 2; i++) {
+    text->scratch[i] = NULL;
+    text->scratch_capacity[i] = 0;
+  }
+  if (self->edited) return 0;
+  if (self->text_buffer) {
+    text->text_buffer = self->text_buffer;
+    text->data = self->text_buffer->data;
+    text->length = self->text_buffer->length;
+    return 1;
+  }
+  if (self->source == NULL || self->source == Py_None) return 0;
+  if (PyBytes_CheckExact(self->source)) {
+    text->data = PyBytes_AS_STRING(self->source);
+    text->length = (size_t)PyBytes_GET_SIZE(self->source);
+    return 1;
+  }
+  if (PyObject_GetBuffer(self->source, &text->buffer, PyBUF_SIMPLE) < 0) return -1;
+  text->has_buffer = true;
+  text->data = text->buffer.buf;
+  text->length = (size_t)text->buffer.len;
+  return 1;
+}
+
+static void tree_text_release(TreeText *text) {
+  if (text->has_buffer) PyBuffer_Release(&text->buffer);
+  text->has_buffer = false;
+  for (int i = 0; i < 2; i++) {
+    PyMem_Free(text->scratch[i]);
+    text->scratch[i] = NULL;
+    text->scratch_capacity[i] = 0;
+  }
+}
+
+// Returns the node's text, which stays valid until the text is released or
+// the same scratch buffer (0 or 1) is used again, or NULL on error.
+static const char *tree_text_for_node(
+  TreeText *text,
+  TSNode node,
+  size_t *length,
+  int scratch
+) {
+  size_t start = ts_node_start_byte(node);
+  size_t end = ts_node_end_byte(node);
+  if (end > text->length) end = text->length;
+  if (start > end) start = end;
+  *length = end - start;
+
+  TextBuffer *buffer = text->text_buffer;
+  if (!buffer || end <= buffer->gap_start) return text->data + start;
+  if (start >= buffer->gap_start) return text->data + buffer->gap_size + start;
+
+  if (text->scratch_capacity[scratch] < *length) {
+    char *data = PyMem_Realloc(text->scratch[scratch], *length);
+    if (data == NULL) {
+      PyErr_NoMemory();
+      return NULL;
+    }
+    text->scratch[scratch] = data;
+    text->scratch_capacity[scratch] = *length;
+  }
+  text_buffer_copy(buffer, start, end, text->scratch[scratch]);
+  return text->scratch[scratch];
+}
+
 // TreeCursor
 
 static void tree_cursor_dealloc(TreeCursor *self) {
@@ -561,6 +2563,18 @@ static PyObject *tree_cursor_goto_next_sibling(TreeCursor *self, PyObject *args)
   return PyBool_FromLong(result);
 }
 
+static PyObject *tree_cursor_goto_first_child_for_byte(TreeCursor *self, PyObject *arg) {
+  uint32_t byte;
+  if (uint32_from_arg(arg, &byte) < 0) return NULL;
+  int64_t result = ts_tree_cursor_goto_first_child_for_byte(&self->cursor, byte);
+  if (result < 0) {
+    Py_RETURN_NONE;
+  }
+  Py_XDECREF(self->node);
+  self->node = NULL;
+  return PyLong_FromLongLong(result);
+}
+
 static PyMethodDef tree_cursor_methods[] = {
   {
     .ml_name = "current_field_name",
@@ -588,6 +2602,15 @@ static PyMethodDef tree_cursor_methods[] = {
                If the current node has children, move to the first child and\n\
                return True. Otherwise, return False.",
   },
+  {
+    .ml_name = "goto_first_child_for_byte",
+    .ml_meth = (PyCFunction)tree_cursor_goto_first_child_for_byte,
+    .ml_flags = METH_O,
+    .ml_doc = "goto_first_child_for_byte(byte)\n--\n\n\
+               Go to the first child that extends beyond the given byte.\n\n\
+               If there is such a child, move to it and return its index.\n\
+               Otherwise, return None.",
+  },
   {
     .ml_name = "goto_next_sibling",
     .ml_meth = (PyCFunction)tree_cursor_goto_next_sibling,
@@ -600,239 +2623,2858 @@ static PyMethodDef tree_cursor_methods[] = {
   {NULL},
 };
 
-static PyGetSetDef tree_cursor_accessors[] = {
-  {"node", (getter)tree_cursor_get_node, NULL, "The current node.", NULL},
-  {NULL},
+static PyGetSetDef tree_cursor_accessors[] = {
+  {"node", (getter)tree_cursor_get_node, NULL, "The current node.", NULL},
+  {NULL},
+};
+
+static PyObject *tree_cursor_getattro(TreeCursor *self, PyObject *name) {
+  if (!tree_check_open(self->tree)) return NULL;
+  return PyObject_GenericGetAttr((PyObject *)self, name);
+}
+
+static PyTypeObject tree_cursor_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.TreeCursor",
+  .tp_doc = "A syntax tree cursor.",
+  .tp_basicsize = sizeof(TreeCursor),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor)tree_cursor_dealloc,
+  .tp_getattro = (getattrofunc)tree_cursor_getattro,
+  .tp_methods = tree_cursor_methods,
+  .tp_getset = tree_cursor_accessors,
+};
+
+static PyObject *tree_cursor_new_internal(TSNode node, PyObject *tree) {
+  TreeCursor *self = (TreeCursor *)tree_cursor_type.tp_alloc(&tree_cursor_type, 0);
+  if (self != NULL) {
+    self->cursor = ts_tree_cursor_new(node);
+    Py_INCREF(tree);
+    self->tree = tree;
+  }
+  return (PyObject *)self;
+}
+
+// NodeIterator
+
+static void node_iterator_dealloc(NodeIterator *self) {
+  ts_tree_cursor_delete(&self->cursor);
+  PyMem_Free(self->symbols);
+  Py_XDECREF(self->tree);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static bool node_iterator_in_range(NodeIterator *self, TSNode node) {
+  if (!self->has_range) return true;
+  uint32_t start_byte = ts_node_start_byte(node);
+  uint32_t end_byte = ts_node_end_byte(node);
+  if (start_byte == end_byte) {
+    return start_byte >= self->start_byte && start_byte <= self->end_byte;
+  }
+  return start_byte < self->end_byte && end_byte > self->start_byte;
+}
+
+// Move to the next node in preorder. Returns false when the walk is over.
+static bool node_iterator_advance_preorder(NodeIterator *self) {
+  if (!self->started) {
+    self->started = true;
+    return true;
+  }
+  if (!self->skip_children && ts_tree_cursor_goto_first_child(&self->cursor)) {
+    self->depth++;
+    return true;
+  }
+  while (self->depth > 0) {
+    if (ts_tree_cursor_goto_next_sibling(&self->cursor)) return true;
+    ts_tree_cursor_goto_parent(&self->cursor);
+    self->depth--;
+  }
+  return false;
+}
+
+// Starting from a node that hasn't been visited, move down to the first node
+// in postorder, skipping the subtrees that are out of range.
+static bool node_iterator_descend_postorder(NodeIterator *self) {
+  for (;;) {
+    TSNode node = ts_tree_cursor_current_node(&self->cursor);
+    if (!node_iterator_in_range(self, node)) {
+      if (self->depth == 0) return false;
+      if (ts_tree_cursor_goto_next_sibling(&self->cursor)) continue;
+      ts_tree_cursor_goto_parent(&self->cursor);
+      self->depth--;
+      return true;
+    }
+    if (!ts_tree_cursor_goto_first_child(&self->cursor)) return true;
+    self->depth++;
+  }
+}
+
+static bool node_iterator_advance_postorder(NodeIterator *self) {
+  if (!self->started) {
+    self->started = true;
+    return node_iterator_descend_postorder(self);
+  }
+  if (self->depth == 0) return false;
+  if (ts_tree_cursor_goto_next_sibling(&self->cursor)) {
+    return node_iterator_descend_postorder(self);
+  }
+  ts_tree_cursor_goto_parent(&self->cursor);
+  self->depth--;
+  return true;
+}
+
+static PyObject *node_iterator_next(NodeIterator *self) {
+  if (!self->done && !tree_check_open(self->tree)) return NULL;
+  while (!self->done) {
+    bool moved = self->postorder
+      ? node_iterator_advance_postorder(self)
+      : node_iterator_advance_preorder(self);
+    if (!moved) {
+      self->done = true;
+      break;
+    }
+
+    TSNode node = ts_tree_cursor_current_node(&self->cursor);
+    if (!self->postorder) {
+      self->skip_children = !node_iterator_in_range(self, node);
+      if (self->skip_children) continue;
+    }
+    if (self->named_only && !ts_node_is_named(node)) continue;
+    if (self->symbols) {
+      TSSymbol symbol = ts_node_symbol(node);
+      if (symbol >= self->symbol_count || !self->symbols[symbol]) continue;
+    }
+
+    PyObject *result = node_new_internal(node, self->tree);
+    if (result == NULL || !self->with_info) return result;
+
+    const char *field_name = ts_tree_cursor_current_field_name(&self->cursor);
+    return Py_BuildValue(
+      "(NIs)",
+      result,
+      self->depth,
+      field_name
+    );
+  }
+  return NULL;
+}
+
+static PyTypeObject node_iterator_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.NodeIterator",
+  .tp_doc = "An iterator over the nodes of a syntax tree.",
+  .tp_basicsize = sizeof(NodeIterator),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor)node_iterator_dealloc,
+  .tp_iter = PyObject_SelfIter,
+  .tp_iternext = (iternextfunc)node_iterator_next,
+};
+
+// Mark the symbols whose names are in `types`. A name can belong to several
+// symbols, such as a named node type and an alias with the same name.
+static int node_iterator_set_types(NodeIterator *self, const TSLanguage *language, PyObject *types) {
+  PyObject *names = PyFrozenSet_New(types);
+  if (names == NULL) return -1;
+
+  self->symbol_count = ts_language_symbol_count(language);
+  self->symbols = PyMem_Calloc(self->symbol_count ? self->symbol_count : 1, sizeof(bool));
+  if (self->symbols == NULL) {
+    Py_DECREF(names);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  for (uint32_t symbol = 0; symbol < self->symbol_count; symbol++) {
+    PyObject *name = PyUnicode_FromString(ts_language_symbol_name(language, (TSSymbol)symbol));
+    if (name == NULL) {
+      Py_DECREF(names);
+      return -1;
+    }
+    int found = PySet_Contains(names, name);
+    Py_DECREF(name);
+    if (found < 0) {
+      Py_DECREF(names);
+      return -1;
+    }
+    self->symbols[symbol] = found;
+  }
+  Py_DECREF(names);
+  return 0;
+}
+
+static PyObject *node_iterator_new_internal(TSNode node, PyObject *tree, PyObject *args, PyObject *kwargs) {
+  char *keywords[] = {
+    "order",
+    "named_only",
+    "types",
+    "start_byte",
+    "end_byte",
+    "with_info",
+    NULL,
+  };
+  const char *order = "preorder";
+  int named_only = 0, with_info = 0;
+  PyObject *types = Py_None, *start_byte = Py_None, *end_byte = Py_None;
+  int ok = PyArg_ParseTupleAndKeywords(
+    args,
+    kwargs,
+    "|spOOOp",
+    keywords,
+    &order,
+    &named_only,
+    &types,
+    &start_byte,
+    &end_byte,
+    &with_info
+  );
+  if (!ok) return NULL;
+
+  bool postorder;
+  if (strcmp(order, "preorder") == 0) {
+    postorder = false;
+  } else if (strcmp(order, "postorder") == 0) {
+    postorder = true;
+  } else {
+    PyErr_SetString(PyExc_ValueError, "order must be 'preorder' or 'postorder'");
+    return NULL;
+  }
+
+  NodeIterator *self = (NodeIterator *)node_iterator_type.tp_alloc(&node_iterator_type, 0);
+  if (self == NULL) return NULL;
+  self->cursor = ts_tree_cursor_new(node);
+  Py_INCREF(tree);
+  self->tree = tree;
+  self->postorder = postorder;
+  self->named_only = named_only;
+  self->with_info = with_info;
+  self->start_byte = 0;
+  self->end_byte = UINT32_MAX;
+  self->has_range = start_byte != Py_None || end_byte != Py_None;
+
+  if (
+    (start_byte != Py_None && !PyArg_Parse(start_byte, "I", &self->start_byte)) ||
+    (end_byte != Py_None && !PyArg_Parse(end_byte, "I", &self->end_byte)) ||
+    (types != Py_None && node_iterator_set_types(self, ts_tree_language(((Tree *)tree)->tree), types) < 0)
+  ) {
+    Py_DECREF(self);
+    return NULL;
+  }
+  return (PyObject *)self;
+}
+
+// Language
+
+// Libraries are opened once per path and never closed, since trees and
+// queries keep pointers into them.
+static PyObject *language_libraries;
+
+static int language_check_version(const TSLanguage *language) {
+  unsigned version = ts_language_version(language);
+  if (version < TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION || TREE_SITTER_LANGUAGE_VERSION < version) {
+    PyErr_Format(
+      PyExc_ValueError,
+      "Incompatible Language version %u. Must be between %u and %u",
+      version,
+      TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION,
+      TREE_SITTER_LANGUAGE_VERSION
+    );
+    return -1;
+  }
+  return 0;
+}
+
+// Return the handle of the dynamic library at the given path, opening it if
+// it isn't open yet.
+static void *language_open_library(PyObject *path) {
+  PyObject *handle_object = PyDict_GetItemWithError(language_libraries, path);
+  if (handle_object) return PyLong_AsVoidPtr(handle_object);
+  if (PyErr_Occurred()) return NULL;
+
+#ifdef _WIN32
+  wchar_t *wide_path = PyUnicode_AsWideCharString(path, NULL);
+  if (wide_path == NULL) return NULL;
+  void *handle = (void *)LoadLibraryW(wide_path);
+  PyMem_Free(wide_path);
+  if (handle == NULL) {
+    PyErr_SetFromWindowsErr(0);
+    return NULL;
+  }
+#else
+  PyObject *path_bytes;
+  if (!PyUnicode_FSConverter(path, &path_bytes)) return NULL;
+  void *handle = dlopen(PyBytes_AS_STRING(path_bytes), RTLD_NOW | RTLD_LOCAL);
+  Py_DECREF(path_bytes);
+  if (handle == NULL) {
+    PyErr_SetString(PyExc_OSError, dlerror());
+    return NULL;
+  }
+#endif
+
+  handle_object = PyLong_FromVoidPtr(handle);
+  if (handle_object == NULL) return NULL;
+  int status = PyDict_SetItem(language_libraries, path, handle_object);
+  Py_DECREF(handle_object);
+  return status < 0 ? NULL : handle;
+}
+
+static int language_init(Language *self, PyObject *args, PyObject *kwargs) {
+  char *keywords[] = {"library_path", "name", NULL};
+  PyObject *library_path;
+  const char *name;
+  if (!PyArg_ParseTupleAndKeywords(
+    args, kwargs, "O&s", keywords, PyUnicode_FSDecoder, &library_path, &name
+  )) return -1;
+
+  void *handle = language_open_library(library_path);
+  Py_DECREF(library_path);
+  if (handle == NULL) return -1;
+
+  PyObject *symbol_name = PyUnicode_FromFormat("tree_sitter_%s", name);
+  if (symbol_name == NULL) return -1;
+  const char *symbol = PyUnicode_AsUTF8(symbol_name);
+#ifdef _WIN32
+  void *function = symbol ? (void *)GetProcAddress((HMODULE)handle, symbol) : NULL;
+#else
+  void *function = symbol ? dlsym(handle, symbol) : NULL;
+#endif
+  if (function == NULL) {
+    if (symbol) PyErr_Format(PyExc_AttributeError, "Language library has no function %s", symbol);
+    Py_DECREF(symbol_name);
+    return -1;
+  }
+  Py_DECREF(symbol_name);
+
+  TSLanguage *language = ((TSLanguage *(*)(void))function)();
+  if (language == NULL) {
+    PyErr_SetString(PyExc_ValueError, "Language function returned null");
+    return -1;
+  }
+  if (language_check_version(language) < 0) return -1;
+  self->language = language;
+  return 0;
+}
+
+static void language_dealloc(Language *self) {
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *language_get_language_id(Language *self, void *payload) {
+  if (self->language == NULL) {
+    PyErr_SetString(PyExc_ValueError, "Language is not loaded");
+    return NULL;
+  }
+  return PyLong_FromVoidPtr(self->language);
+}
+
+static PyObject *language_get_version(Language *self, void *payload) {
+  if (self->language == NULL) {
+    PyErr_SetString(PyExc_ValueError, "Language is not loaded");
+    return NULL;
+  }
+  return PyLong_FromUnsignedLong(ts_language_version(self->language));
+}
+
+static PyGetSetDef language_accessors[] = {
+  {"language_id", (getter)language_get_language_id, NULL, "The address of the TSLanguage, as an integer.", NULL},
+  {"version", (getter)language_get_version, NULL, "The ABI version of the language.", NULL},
+  {NULL}
+};
+
+static PyTypeObject language_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.binding.Language",
+  .tp_doc = "A language loaded from a dynamic library",
+  .tp_basicsize = sizeof(Language),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  .tp_new = PyType_GenericNew,
+  .tp_init = (initproc)language_init,
+  .tp_dealloc = (destructor)language_dealloc,
+  .tp_getset = language_accessors,
+};
+
+static bool language_is_instance(PyObject *self) {
+  return PyObject_TypeCheck(self, &language_type) && ((Language *)self)->language != NULL;
+}
+
+// Parser
+
+static PyObject *parser_new(
+  PyTypeObject *type,
+  PyObject *args,
+  PyObject *kwds
+) {
+  Parser *self = (Parser *)type->tp_alloc(type, 0);
+  if (self == NULL) return NULL;
+
+  self->lock = PyThread_allocate_lock();
+  if (self->lock == NULL) {
+    Py_DECREF(self);
+    PyErr_SetString(PyExc_MemoryError, "Unable to allocate parser lock");
+    return NULL;
+  }
+  self->parser = ts_parser_new();
+  ts_parser_set_cancellation_flag(self->parser, &self->cancellation_flag);
+  return (PyObject *)self;
+}
+
+static void parser_log_delete(ParserLog *log) {
+  if (!log) return;
+  PyMem_RawFree(log->data);
+  PyMem_RawFree(log);
+}
+
+static void parser_dealloc(Parser *self) {
+  parser_log_delete(self->log);
+  Py_XDECREF(self->halted_source);
+  Py_XDECREF(self->halted_old_tree);
+  Py_XDECREF(self->included_ranges);
+  for (size_t i = 0; i < self->pool_size; i++) {
+    ts_parser_delete(self->pool[i]);
+  }
+  PyMem_Free(self->pool);
+  if (self->parser) ts_parser_delete(self->parser);
+  if (self->lock) PyThread_free_lock(self->lock);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// A `TSParser` can only run one parse at a time. Since parsing happens with
+// the GIL released, every use of `self->parser` goes through this lock. Wait
+// for it without holding the GIL, so that a thread blocked on a busy parser
+// does not stall the rest of the interpreter. The thread that holds the lock
+// can only use the parser again from a callback, such as a read callback that
+// parses with the same parser; that would deadlock, so it raises instead.
+static int parser_acquire(Parser *self) {
+  unsigned long thread = PyThread_get_thread_ident();
+  if (self->owner == thread) {
+    PyErr_SetString(PyExc_RuntimeError, "Parser is already in use by this thread");
+    return -1;
+  }
+  if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+  }
+  self->owner = thread;
+  return 0;
+}
+
+static void parser_release(Parser *self) {
+  self->owner = 0;
+  PyThread_release_lock(self->lock);
+}
+
+// Start a parse of the given input. A halted parse is only resumed when it is
+// for the same input, and is otherwise discarded. Must be called while
+// holding the parser lock.
+static void parser_begin(Parser *self, PyObject *source, PyObject *old_tree) {
+  if (!self->halted_source) return;
+  if (self->halted_source != source || self->halted_old_tree != old_tree) {
+    ts_parser_reset(self->parser);
+  }
+  Py_CLEAR(self->halted_source);
+  Py_CLEAR(self->halted_old_tree);
+}
+
+// Remember the input of a parse that returned no tree, so that it can be
+// resumed. Must be called while holding the parser lock.
+static void parser_halt(Parser *self, PyObject *source, PyObject *old_tree) {
+  if (!ts_parser_language(self->parser)) return;
+  Py_INCREF(source);
+  self->halted_source = source;
+  Py_XINCREF(old_tree);
+  self->halted_old_tree = old_tree;
+}
+
+// Raise the error for a parse that returned no tree.
+static PyObject *parser_parse_error(Parser *self) {
+  if (!ts_parser_language(self->parser)) {
+    PyErr_SetString(PyExc_ValueError, "Parsing failed");
+  } else if (self->cancellation_flag) {
+    self->cancellation_flag = 0;
+    PyErr_SetString(PyExc_RuntimeError, "Parsing was cancelled");
+  } else {
+    PyErr_SetString(PyExc_TimeoutError, "Parsing timed out");
+  }
+  return NULL;
+}
+
+// Parse statistics
+
+// A monotonic clock in seconds, which can be read without the GIL.
+static double parser_clock(void) {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+#endif
+}
+
+// Record the statistics of a parse that started at `start_time`, if they are
+// being collected. `bytes` is 0 when the length of the input isn't known, in
+// which case the end of the root node is used. This walks the whole tree to
+// count its nodes, so it runs without the GIL, while holding the parser lock.
+static void parser_record_stats(
+  Parser *self,
+  const TSTree *tree,
+  double start_time,
+  uint32_t bytes,
+  bool incremental
+) {
+  if (!self->collect_stats) return;
+  double wall_time = parser_clock() - start_time;
+  self->has_stats = tree != NULL;
+  if (!tree) return;
+
+  TSNode root = ts_tree_root_node(tree);
+  ParseStats stats = {
+    .wall_time = wall_time,
+    .bytes = bytes ? bytes : ts_node_end_byte(root),
+    .node_count = 0,
+    .error_count = 0,
+    .incremental = incremental,
+  };
+  TSTreeCursor cursor = ts_tree_cursor_new(root);
+  for (;;) {
+    TSNode node = ts_tree_cursor_current_node(&cursor);
+    stats.node_count++;
+    // Error recovery either wraps skipped input in an ERROR node, whose
+    // symbol is the highest one, or inserts a missing node.
+    if (ts_node_symbol(node) == (TSSymbol)-1 || ts_node_is_missing(node)) {
+      stats.error_count++;
+    }
+    // Subtrees without errors are still walked, to count their nodes.
+    if (ts_tree_cursor_goto_first_child(&cursor)) continue;
+    while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+      if (!ts_tree_cursor_goto_parent(&cursor)) goto done;
+    }
+  }
+
+done:
+  ts_tree_cursor_delete(&cursor);
+  self->stats = stats;
+}
+
+// Called by tree-sitter, without the GIL, for every log message while logging
+// is enabled. Runs while holding the parser lock.
+static void parser_log(void *payload, TSLogType type, const char *message) {
+  ParserLog *log = (ParserLog *)payload;
+  if (log->message_count++ % log->sample != 0) return;
+
+  const char *prefix = type == TSLogTypeLex ? "lex: " : "parse: ";
+  size_t prefix_length = strlen(prefix), message_length = strlen(message);
+  size_t length = prefix_length + message_length + 1;
+  if (log->length + length > log->max_bytes) return;
+  if (log->length + length > log->capacity) {
+    size_t capacity = log->capacity ? log->capacity * 2 : 4096;
+    while (capacity < log->length + length) capacity *= 2;
+    if (capacity > log->max_bytes) capacity = log->max_bytes;
+    char *data = PyMem_RawRealloc(log->data, capacity);
+    if (!data) return;
+    log->data = data;
+    log->capacity = capacity;
+  }
+  memcpy(&log->data[log->length], prefix, prefix_length);
+  memcpy(&log->data[log->length + prefix_length], message, message_length);
+  log->data[log->length + length - 1] = '\n';
+  log->length += length;
+}
+
+typedef struct {
+  PyObject *read_callback;
+  PyObject *chunk;
+  PyThreadState *thread_state;
+  int failed;
+} ParserReadPayload;
+
+// Called by tree-sitter, without the GIL, whenever the lexer needs more input.
+// The GIL is only held while calling back into Python. The returned chunk is
+// kept alive until the next call, as tree-sitter reads from it until then.
+static const char *parser_read(
+  void *payload,
+  uint32_t byte_offset,
+  TSPoint position,
+  uint32_t *bytes_read
+) {
+  ParserReadPayload *read = (ParserReadPayload *)payload;
+  const char *result = "";
+  *bytes_read = 0;
+  if (read->failed) return result;
+
+  PyEval_RestoreThread(read->thread_state);
+  Py_CLEAR(read->chunk);
+
+  PyObject *point = point_new(position);
+  PyObject *chunk = NULL;
+  if (point) {
+    chunk = PyObject_CallFunction(read->read_callback, "IO", byte_offset, point);
+    Py_DECREF(point);
+  }
+
+  if (chunk == NULL) {
+    read->failed = 1;
+  } else if (chunk == Py_None) {
+    Py_DECREF(chunk);
+  } else if (!PyBytes_Check(chunk)) {
+    PyErr_SetString(PyExc_TypeError, "Read callback must return bytes or None");
+    Py_DECREF(chunk);
+    read->failed = 1;
+  } else if ((size_t)PyBytes_GET_SIZE(chunk) > UINT32_MAX) {
+    PyErr_SetString(PyExc_ValueError, "Read callback returned too many bytes");
+    Py_DECREF(chunk);
+    read->failed = 1;
+  } else {
+    read->chunk = chunk;
+    *bytes_read = (uint32_t)PyBytes_GET_SIZE(chunk);
+    result = PyBytes_AS_STRING(chunk);
+  }
+
+  read->thread_state = PyEval_SaveThread();
+  return result;
+}
+
+static PyObject *parser_parse_callback(
+  Parser *self,
+  PyObject *read_callback,
+  PyObject *old_tree_arg
+) {
+  const TSTree *old_tree = old_tree_arg ? ((Tree *)old_tree_arg)->tree : NULL;
+  ParserReadPayload payload = {
+    .read_callback = read_callback,
+    .chunk = NULL,
+    .thread_state = NULL,
+    .failed = 0,
+  };
+  TSInput input = {
+    .payload = &payload,
+    .read = parser_read,
+    .encoding = TSInputEncodingUTF8,
+  };
+
+  if (parser_acquire(self) < 0) return NULL;
+  parser_begin(self, read_callback, old_tree_arg);
+  if (old_tree_arg) ((Tree *)old_tree_arg)->in_use++;
+  payload.thread_state = PyEval_SaveThread();
+  double start_time = parser_clock();
+  int64_t start_bytes = thread_allocated_bytes;
+  TSTree *new_tree = ts_parser_parse(self->parser, old_tree, input);
+  size_t native_bytes = allocation_since(start_bytes);
+  if (!payload.failed) parser_record_stats(self, new_tree, start_time, 0, old_tree != NULL);
+  PyEval_RestoreThread(payload.thread_state);
+  if (old_tree_arg) ((Tree *)old_tree_arg)->in_use--;
+  if (payload.failed) {
+    ts_parser_reset(self->parser);
+  } else if (!new_tree) {
+    parser_halt(self, read_callback, old_tree_arg);
+  }
+  PyObject *included_ranges = self->included_ranges;
+  Py_XINCREF(included_ranges);
+  parser_release(self);
+  Py_XDECREF(payload.chunk);
+
+  if (payload.failed) {
+    if (new_tree) ts_tree_delete(new_tree);
+    Py_XDECREF(included_ranges);
+    return NULL;
+  }
+  if (!new_tree) {
+    Py_XDECREF(included_ranges);
+    return parser_parse_error(self);
+  }
+
+  PyObject *result = tree_new_internal(new_tree, Py_None);
+  if (result) {
+    ((Tree *)result)->native_bytes = native_bytes;
+    ((Tree *)result)->included_ranges = included_ranges;
+  } else {
+    Py_XDECREF(included_ranges);
+  }
+  return result;
+}
+
+// Reparse the text that an old tree has been edited to. The gap buffer moves
+// from the old tree to the new one, so it is never copied.
+static PyObject *parser_parse_text_buffer(Parser *self, Tree *old_tree) {
+  if (!old_tree || !old_tree->text_buffer) {
+    PyErr_SetString(
+      PyExc_ValueError,
+      "Source can only be None when old_tree was edited with new_text"
+    );
+    return NULL;
+  }
+
+  if (parser_acquire(self) < 0) return NULL;
+  TextBuffer *buffer = old_tree->text_buffer;
+  int edited = old_tree->edited;
+  old_tree->text_buffer = NULL;
+  old_tree->edited = 1;
+  Py_CLEAR(old_tree->source_view);
+  Py_CLEAR(old_tree->source);
+
+  TSInput input = {
+    .payload = buffer,
+    .read = text_buffer_read,
+    .encoding = TSInputEncodingUTF8,
+  };
+  TSTree *new_tree;
+  size_t native_bytes;
+  parser_begin(self, Py_None, (PyObject *)old_tree);
+  old_tree->in_use++;
+  Py_BEGIN_ALLOW_THREADS
+  double start_time = parser_clock();
+  int64_t start_bytes = thread_allocated_bytes;
+  new_tree = ts_parser_parse(self->parser, old_tree->tree, input);
+  native_bytes = allocation_since(start_bytes);
+  parser_record_stats(self, new_tree, start_time, (uint32_t)buffer->length, true);
+  Py_END_ALLOW_THREADS
+  old_tree->in_use--;
+  if (!new_tree) parser_halt(self, Py_None, (PyObject *)old_tree);
+  PyObject *included_ranges = self->included_ranges;
+  Py_XINCREF(included_ranges);
+  parser_release(self);
+
+  // A halted parse leaves the text with the old tree, so that it can be
+  // resumed.
+  if (!new_tree) {
+    old_tree->text_buffer = buffer;
+    old_tree->edited = edited;
+    Py_XDECREF(included_ranges);
+    return parser_parse_error(self);
+  }
+
+  Tree *result = (Tree *)tree_new_internal(new_tree, NULL);
+  if (result == NULL) {
+    text_buffer_delete(buffer);
+    Py_XDECREF(included_ranges);
+    return NULL;
+  }
+  result->text_buffer = buffer;
+  result->native_bytes = native_bytes;
+  result->included_ranges = included_ranges;
+  return (PyObject *)result;
+}
+
+static PyObject *parser_parse(Parser *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  static const char *const keywords[] = {"source", "old_tree", NULL};
+  PyObject *values[2] = {NULL, NULL};
+  if (parse_fastcall_args("parse", args, nargs, kwnames, keywords, 1, values) < 0) {
+    return NULL;
+  }
+  PyObject *source_code = values[0];
+  PyObject *old_tree_arg = values[1] == Py_None ? NULL : values[1];
+
+  const TSTree *old_tree = NULL;
+  if (old_tree_arg) {
+    if (!PyObject_IsInstance(old_tree_arg, (PyObject *)&tree_type)) {
+      PyErr_SetString(PyExc_TypeError, "Second argument to parse must be a Tree");
+      return NULL;
+    }
+    if (!tree_check_open(old_tree_arg)) return NULL;
+
+    old_tree = ((Tree *)old_tree_arg)->tree;
+  }
+
+  if (source_code == Py_None) {
+    return parser_parse_text_buffer(self, (Tree *)old_tree_arg);
+  }
+
+  if (!PyObject_CheckBuffer(source_code)) {
+    if (PyCallable_Check(source_code)) {
+      return parser_parse_callback(self, source_code, old_tree_arg);
+    }
+    PyErr_SetString(
+      PyExc_TypeError,
+      "First argument to parse must be a bytes-like object or a callable"
+    );
+    return NULL;
+  }
+
+  // Holding a buffer export pins the memory while the GIL is released:
+  // objects like `bytearray` and `mmap` refuse to resize or close until the
+  // buffer is released.
+  Py_buffer source_buffer;
+  if (PyObject_GetBuffer(source_code, &source_buffer, PyBUF_SIMPLE) < 0) {
+    return NULL;
+  }
+  if ((size_t)source_buffer.len > UINT32_MAX) {
+    PyBuffer_Release(&source_buffer);
+    PyErr_SetString(PyExc_ValueError, "Source code is too large");
+    return NULL;
+  }
+
+  TSTree *new_tree;
+  size_t native_bytes;
+  if (parser_acquire(self) < 0) {
+    PyBuffer_Release(&source_buffer);
+    return NULL;
+  }
+  parser_begin(self, source_code, old_tree_arg);
+  if (old_tree_arg) ((Tree *)old_tree_arg)->in_use++;
+  Py_BEGIN_ALLOW_THREADS
+  double start_time = parser_clock();
+  int64_t start_bytes = thread_allocated_bytes;
+  new_tree = ts_parser_parse_string(
+    self->parser,
+    old_tree,
+    source_buffer.buf,
+    (uint32_t)source_buffer.len
+  );
+  native_bytes = allocation_since(start_bytes);
+  parser_record_stats(self, new_tree, start_time, (uint32_t)source_buffer.len, old_tree != NULL);
+  Py_END_ALLOW_THREADS
+  if (old_tree_arg) ((Tree *)old_tree_arg)->in_use--;
+  if (!new_tree) parser_halt(self, source_code, old_tree_arg);
+  PyObject *included_ranges = self->included_ranges;
+  Py_XINCREF(included_ranges);
+  parser_release(self);
+  PyBuffer_Release(&source_buffer);
+
+  if (!new_tree) {
+    Py_XDECREF(included_ranges);
+    return parser_parse_error(self);
+  }
+
+  PyObject *result = tree_new_internal(new_tree, source_code);
+  if (result) {
+    ((Tree *)result)->native_bytes = native_bytes;
+    ((Tree *)result)->included_ranges = included_ranges;
+  } else {
+    Py_XDECREF(included_ranges);
+  }
+  return result;
+}
+
+static PyObject *parser_set_language(Parser *self, PyObject *arg) {
+  TSLanguage *language;
+  if (language_is_instance(arg)) {
+    // Native languages are validated when they are loaded.
+    language = ((Language *)arg)->language;
+  } else {
+    PyObject *language_id = PyObject_GetAttrString(arg, "language_id");
+    if (!language_id) {
+      PyErr_SetString(PyExc_TypeError, "Argument to set_language must be a Language");
+      return NULL;
+    }
+
+    if (!PyLong_Check(language_id)) {
+      Py_DECREF(language_id);
+      PyErr_SetString(PyExc_TypeError, "Language ID must be an integer");
+      return NULL;
+    }
+
+    language = (TSLanguage *)PyLong_AsVoidPtr(language_id);
+    Py_DECREF(language_id);
+    if (!language) {
+      PyErr_SetString(PyExc_ValueError, "Language ID must not be null");
+      return NULL;
+    }
+    if (language_check_version(language) < 0) return NULL;
+  }
+
+  if (parser_acquire(self) < 0) return NULL;
+  parser_begin(self, NULL, NULL);
+  ts_parser_set_language(self->parser, language);
+  for (size_t i = 0; i < self->pool_size; i++) {
+    ts_parser_set_language(self->pool[i], language);
+  }
+  parser_release(self);
+  Py_RETURN_NONE;
+}
+
+static int included_range_compare(const void *a, const void *b) {
+  uint32_t left = ((const TSRange *)a)->start_byte;
+  uint32_t right = ((const TSRange *)b)->start_byte;
+  return left < right ? -1 : left > right ? 1 : 0;
+}
+
+// Convert an item of an included ranges sequence, which can be a Range, a Node
+// or a (node, capture_name) tuple from `Query.captures`.
+static int included_range_from_arg(PyObject *arg, TSRange *range) {
+  if (PyTuple_Check(arg) && PyTuple_GET_SIZE(arg) == 2) {
+    arg = PyTuple_GET_ITEM(arg, 0);
+  }
+  if (range_is_instance(arg)) {
+    *range = ((Range *)arg)->range;
+  } else if (node_is_instance(arg)) {
+    if (!tree_check_open(((Node *)arg)->tree)) return -1;
+    TSNode node = ((Node *)arg)->node;
+    range->start_point = ts_node_start_point(node);
+    range->end_point = ts_node_end_point(node);
+    range->start_byte = ts_node_start_byte(node);
+    range->end_byte = ts_node_end_byte(node);
+  } else {
+    PyErr_SetString(
+      PyExc_TypeError,
+      "Included ranges must be Range objects, nodes or (node, capture_name) tuples"
+    );
+    return -1;
+  }
+  if (range->end_byte < range->start_byte) {
+    PyErr_SetString(PyExc_ValueError, "Included range ends before it starts");
+    return -1;
+  }
+  return 0;
+}
+
+static PyObject *parser_set_included_ranges(Parser *self, PyObject *arg) {
+  PyObject *items = PySequence_Fast(arg, "Included ranges must be a sequence");
+  if (items == NULL) return NULL;
+
+  Py_ssize_t count = PySequence_Fast_GET_SIZE(items);
+  TSRange *ranges = PyMem_Malloc((count + 1) * sizeof(TSRange));
+  if (ranges == NULL) {
+    Py_DECREF(items);
+    return PyErr_NoMemory();
+  }
+  for (Py_ssize_t i = 0; i < count; i++) {
+    if (included_range_from_arg(PySequence_Fast_GET_ITEM(items, i), &ranges[i]) < 0) {
+      PyMem_Free(ranges);
+      Py_DECREF(items);
+      return NULL;
+    }
+  }
+  Py_DECREF(items);
+
+  // tree-sitter requires the ranges to be ordered and disjoint. Captures of
+  // nested nodes overlap, so sort the ranges and merge any that overlap.
+  qsort(ranges, count, sizeof(TSRange), included_range_compare);
+  uint32_t length = 0;
+  for (Py_ssize_t i = 0; i < count; i++) {
+    if (length > 0 && ranges[i].start_byte <= ranges[length - 1].end_byte) {
+      if (ranges[i].end_byte > ranges[length - 1].end_byte) {
+        ranges[length - 1].end_byte = ranges[i].end_byte;
+        ranges[length - 1].end_point = ranges[i].end_point;
+      }
+    } else {
+      ranges[length++] = ranges[i];
+    }
+  }
+
+  // An empty list of ranges means the whole document.
+  PyObject *included_ranges = NULL;
+  if (length > 0) {
+    included_ranges = PyTuple_New(length);
+    for (uint32_t i = 0; included_ranges && i < length; i++) {
+      PyObject *range = range_new_internal(ranges[i]);
+      if (range == NULL) {
+        Py_CLEAR(included_ranges);
+        break;
+      }
+      PyTuple_SET_ITEM(included_ranges, i, range);
+    }
+    if (included_ranges == NULL) {
+      PyMem_Free(ranges);
+      return NULL;
+    }
+  }
+
+  if (parser_acquire(self) < 0) {
+    PyMem_Free(ranges);
+    Py_XDECREF(included_ranges);
+    return NULL;
+  }
+  // A halted parse can't be resumed over different ranges.
+  parser_begin(self, NULL, NULL);
+  bool ok = ts_parser_set_included_ranges(self->parser, ranges, length);
+  for (size_t i = 0; ok && i < self->pool_size; i++) {
+    ts_parser_set_included_ranges(self->pool[i], ranges, length);
+  }
+  if (ok) {
+    PyObject *old_ranges = self->included_ranges;
+    self->included_ranges = included_ranges;
+    included_ranges = old_ranges;
+  }
+  parser_release(self);
+  PyMem_Free(ranges);
+  Py_XDECREF(included_ranges);
+
+  if (!ok) {
+    PyErr_SetString(PyExc_ValueError, "Invalid included ranges");
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject *parser_get_included_ranges(Parser *self, void *payload) {
+  if (parser_acquire(self) < 0) return NULL;
+  uint32_t length;
+  const TSRange *ranges = ts_parser_included_ranges(self->parser, &length);
+  PyObject *result = PyList_New(length);
+  for (uint32_t i = 0; result && i < length; i++) {
+    PyObject *range = range_new_internal(ranges[i]);
+    if (range == NULL) {
+      Py_CLEAR(result);
+      break;
+    }
+    PyList_SET_ITEM(result, i, range);
+  }
+  parser_release(self);
+  return result;
+}
+
+// Batch parsing
+
+typedef struct {
+  size_t index;
+  uint32_t length;
+} ParseBatchItem;
+
+typedef struct {
+  PyObject *const *sources;
+  ParseBatchItem *items;
+  TSTree **trees;
+  size_t *native_bytes;
+  size_t count;
+  size_t next;
+  size_t running;
+  PyThread_type_lock lock;
+  PyThread_type_lock done;
+} ParseBatch;
+
+typedef struct {
+  ParseBatch *batch;
+  TSParser *parser;
+} ParseBatchWorker;
+
+static int parse_batch_item_compare(const void *a, const void *b) {
+  uint32_t left = ((const ParseBatchItem *)a)->length;
+  uint32_t right = ((const ParseBatchItem *)b)->length;
+  return left < right ? 1 : left > right ? -1 : 0;
+}
+
+// Workers pull the next unparsed source from a shared queue, so a thread that
+// finishes early keeps taking work until the queue is empty. The queue is
+// ordered largest first, which keeps one huge file from being started last.
+// This runs without the GIL and must not touch any Python API.
+static void parse_batch_run(ParseBatch *batch, TSParser *parser) {
+  for (;;) {
+    PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+    size_t next = batch->next++;
+    PyThread_release_lock(batch->lock);
+    if (next >= batch->count) break;
+
+    ParseBatchItem *item = &batch->items[next];
+    int64_t start_bytes = thread_allocated_bytes;
+    batch->trees[item->index] = ts_parser_parse_string(
+      parser,
+      NULL,
+      PyBytes_AS_STRING(batch->sources[item->index]),
+      item->length
+    );
+    batch->native_bytes[item->index] = allocation_since(start_bytes);
+    // Batches are not resumable, so don't resume a halted parse with the
+    // next source.
+    if (!batch->trees[item->index]) ts_parser_reset(parser);
+  }
+}
+
+static void parse_batch_finish_worker(ParseBatch *batch) {
+  PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+  if (--batch->running == 0) PyThread_release_lock(batch->done);
+  PyThread_release_lock(batch->lock);
+}
+
+static void parse_batch_worker(void *payload) {
+  ParseBatchWorker *worker = payload;
+  parse_batch_run(worker->batch, worker->parser);
+  parse_batch_finish_worker(worker->batch);
+}
+
+static Py_ssize_t parse_batch_cpu_count(void) {
+  Py_ssize_t result = 1;
+  PyObject *os = PyImport_ImportModule("os");
+  if (os == NULL) {
+    PyErr_Clear();
+    return result;
+  }
+  PyObject *count = PyObject_CallMethod(os, "cpu_count", NULL);
+  Py_DECREF(os);
+  if (count && PyLong_Check(count)) result = PyLong_AsSsize_t(count);
+  Py_XDECREF(count);
+  PyErr_Clear();
+  return result > 0 ? result : 1;
+}
+
+// Make sure the parser has `size` extra parsers configured with its current
+// language. Must be called while holding the parser lock.
+static int parser_reserve_pool(Parser *self, size_t size) {
+  if (self->pool_size >= size) return 0;
+
+  TSParser **pool = PyMem_Realloc(self->pool, size * sizeof(TSParser *));
+  if (pool == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  self->pool = pool;
+  const TSLanguage *language = ts_parser_language(self->parser);
+  while (self->pool_size < size) {
+    TSParser *parser = ts_parser_new();
+    ts_parser_set_language(parser, language);
+    ts_parser_set_timeout_micros(parser, ts_parser_timeout_micros(self->parser));
+    uint32_t range_count;
+    const TSRange *ranges = ts_parser_included_ranges(self->parser, &range_count);
+    ts_parser_set_included_ranges(parser, ranges, range_count);
+    ts_parser_set_cancellation_flag(parser, &self->cancellation_flag);
+    self->pool[self->pool_size++] = parser;
+  }
+  return 0;
+}
+
+static PyObject *parser_parse_batch(Parser *self, PyObject *args, PyObject *kwargs) {
+  char *keywords[] = {"sources", "threads", NULL};
+  PyObject *sources_arg = NULL;
+  PyObject *threads_arg = Py_None;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", keywords, &sources_arg, &threads_arg)) {
+    return NULL;
+  }
+
+  Py_ssize_t thread_count;
+  if (threads_arg == Py_None) {
+    thread_count = parse_batch_cpu_count();
+  } else {
+    thread_count = PyLong_AsSsize_t(threads_arg);
+    if (thread_count == -1 && PyErr_Occurred()) return NULL;
+    if (thread_count < 1) {
+      PyErr_SetString(PyExc_ValueError, "threads must be at least 1");
+      return NULL;
+    }
+  }
+
+  if (!ts_parser_language(self->parser)) {
+    PyErr_SetString(PyExc_ValueError, "Parser has no language");
+    return NULL;
+  }
+
+  // Copy the sources into a tuple so that the bytes objects stay alive even if
+  // the caller's list is mutated while the GIL is released.
+  PyObject *sources = PySequence_Tuple(sources_arg);
+  if (sources == NULL) return NULL;
+
+  ParseBatch batch = {0};
+  PyObject *result = NULL;
+  PyObject *included_ranges = NULL;
+  ParseBatchWorker *workers = NULL;
+  batch.count = (size_t)PyTuple_GET_SIZE(sources);
+  batch.sources = &PyTuple_GET_ITEM(sources, 0);
+  if (batch.count == 0) {
+    Py_DECREF(sources);
+    return PyList_New(0);
+  }
+
+  batch.items = PyMem_Malloc(batch.count * sizeof(ParseBatchItem));
+  batch.trees = PyMem_Calloc(batch.count, sizeof(TSTree *));
+  batch.native_bytes = PyMem_Calloc(batch.count, sizeof(size_t));
+  if (!batch.items || !batch.trees || !batch.native_bytes) {
+    PyErr_NoMemory();
+    goto exit;
+  }
+
+  for (size_t i = 0; i < batch.count; i++) {
+    PyObject *source = batch.sources[i];
+    if (!PyBytes_Check(source)) {
+      PyErr_Format(PyExc_TypeError, "Source at index %zu must be bytes", i);
+      goto exit;
+    }
+    if ((size_t)PyBytes_GET_SIZE(source) > UINT32_MAX) {
+      PyErr_Format(PyExc_ValueError, "Source at index %zu is too large", i);
+      goto exit;
+    }
+    batch.items[i].index = i;
+    batch.items[i].length = (uint32_t)PyBytes_GET_SIZE(source);
+  }
+  qsort(batch.items, batch.count, sizeof(ParseBatchItem), parse_batch_item_compare);
+
+  size_t extra_threads = (size_t)thread_count - 1;
+  if (extra_threads > batch.count - 1) extra_threads = batch.count - 1;
+
+  if (extra_threads > 0) {
+    workers = PyMem_Malloc(extra_threads * sizeof(ParseBatchWorker));
+    batch.lock = PyThread_allocate_lock();
+    batch.done = PyThread_allocate_lock();
+    if (!workers || !batch.lock || !batch.done) {
+      PyErr_NoMemory();
+      goto exit;
+    }
+  }
+
+  if (parser_acquire(self) < 0) goto exit;
+  if (parser_reserve_pool(self, extra_threads) < 0) {
+    parser_release(self);
+    goto exit;
+  }
+
+  parser_begin(self, NULL, NULL);
+  Py_BEGIN_ALLOW_THREADS
+  if (extra_threads > 0) {
+    // Whoever brings `running` down to zero releases `done`, including this
+    // thread when a worker fails to start.
+    PyThread_acquire_lock(batch.done, WAIT_LOCK);
+    batch.running = extra_threads;
+    for (size_t i = 0; i < extra_threads; i++) {
+      workers[i].batch = &batch;
+      workers[i].parser = self->pool[i];
+      if (PyThread_start_new_thread(parse_batch_worker, &workers[i]) == (unsigned long)-1) {
+        parse_batch_finish_worker(&batch);
+      }
+    }
+  }
+  parse_batch_run(&batch, self->parser);
+  if (extra_threads > 0) {
+    PyThread_acquire_lock(batch.done, WAIT_LOCK);
+    PyThread_release_lock(batch.done);
+  }
+  Py_END_ALLOW_THREADS
+  included_ranges = self->included_ranges;
+  Py_XINCREF(included_ranges);
+  parser_release(self);
+
+  for (size_t i = 0; i < batch.count; i++) {
+    if (!batch.trees[i]) {
+      parser_parse_error(self);
+      goto exit;
+    }
+  }
+
+  result = PyList_New(batch.count);
+  if (result == NULL) goto exit;
+  for (size_t i = 0; i < batch.count; i++) {
+    PyObject *tree = tree_new_internal(batch.trees[i], batch.sources[i]);
+    batch.trees[i] = NULL;
+    if (tree == NULL) {
+      Py_CLEAR(result);
+      goto exit;
+    }
+    ((Tree *)tree)->native_bytes = batch.native_bytes[i];
+    ((Tree *)tree)->included_ranges = included_ranges;
+    Py_XINCREF(included_ranges);
+    PyList_SET_ITEM(result, i, tree);
+  }
+
+exit:
+  if (batch.trees) {
+    for (size_t i = 0; i < batch.count; i++) {
+      if (batch.trees[i]) ts_tree_delete(batch.trees[i]);
+    }
+  }
+  if (batch.lock) PyThread_free_lock(batch.lock);
+  if (batch.done) PyThread_free_lock(batch.done);
+  PyMem_Free(workers);
+  PyMem_Free(batch.trees);
+  PyMem_Free(batch.native_bytes);
+  PyMem_Free(batch.items);
+  Py_XDECREF(included_ranges);
+  Py_DECREF(sources);
+  return result;
+}
+
+static PyObject *parser_reset(Parser *self, PyObject *args) {
+  if (parser_acquire(self) < 0) return NULL;
+  ts_parser_reset(self->parser);
+  Py_CLEAR(self->halted_source);
+  Py_CLEAR(self->halted_old_tree);
+  parser_release(self);
+  Py_RETURN_NONE;
+}
+
+// This is called from other threads while a parse is running, so it doesn't
+// take the parser lock.
+static PyObject *parser_cancel(Parser *self, PyObject *args) {
+  self->cancellation_flag = 1;
+  Py_RETURN_NONE;
+}
+
+static PyObject *parser_enable_logging(Parser *self, PyObject *args, PyObject *kwargs) {
+  static char *keywords[] = {"sample", "max_bytes", NULL};
+  unsigned int sample = 1;
+  Py_ssize_t max_bytes = 1 << 20;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|In:enable_logging", keywords, &sample, &max_bytes)) {
+    return NULL;
+  }
+  if (sample == 0 || max_bytes <= 0) {
+    PyErr_SetString(PyExc_ValueError, "sample and max_bytes must be positive");
+    return NULL;
+  }
+
+  ParserLog *log = PyMem_RawCalloc(1, sizeof(ParserLog));
+  if (!log) return PyErr_NoMemory();
+  log->sample = sample;
+  log->max_bytes = (size_t)max_bytes;
+
+  if (parser_acquire(self) < 0) {
+    parser_log_delete(log);
+    return NULL;
+  }
+  ts_parser_set_logger(self->parser, (TSLogger) {.payload = log, .log = parser_log});
+  ParserLog *old_log = self->log;
+  self->log = log;
+  parser_release(self);
+  parser_log_delete(old_log);
+  Py_RETURN_NONE;
+}
+
+static PyObject *parser_disable_logging(Parser *self, PyObject *args) {
+  if (parser_acquire(self) < 0) return NULL;
+  ts_parser_set_logger(self->parser, (TSLogger) {.payload = NULL, .log = NULL});
+  ParserLog *log = self->log;
+  self->log = NULL;
+  parser_release(self);
+  parser_log_delete(log);
+  Py_RETURN_NONE;
+}
+
+static PyObject *parser_take_log(Parser *self, PyObject *args) {
+  PyObject *result = PyList_New(0);
+  if (result == NULL) return NULL;
+
+  if (parser_acquire(self) < 0) {
+    Py_DECREF(result);
+    return NULL;
+  }
+  ParserLog *log = self->log;
+  if (log) {
+    const char *line = log->data, *end = log->data + log->length;
+    while (line < end) {
+      const char *newline = memchr(line, '\n', end - line);
+      PyObject *message = PyUnicode_DecodeUTF8(line, newline - line, "replace");
+      if (message == NULL || PyList_Append(result, message) < 0) {
+        Py_XDECREF(message);
+        Py_CLEAR(result);
+        break;
+      }
+      Py_DECREF(message);
+      line = newline + 1;
+    }
+    log->length = 0;
+  }
+  parser_release(self);
+  return result;
+}
+
+static PyObject *parser_print_dot_graphs(Parser *self, PyObject *arg) {
+  int fd = -1;
+  if (arg != Py_None) {
+    int file_fd = PyObject_AsFileDescriptor(arg);
+    if (file_fd < 0) return NULL;
+    // tree-sitter closes the file when it's replaced, so give it its own
+    // descriptor.
+#ifdef _WIN32
+    fd = _dup(file_fd);
+#else
+    fd = dup(file_fd);
+#endif
+    if (fd < 0) return PyErr_SetFromErrno(PyExc_OSError);
+  }
+  if (parser_acquire(self) < 0) {
+#ifdef _WIN32
+    if (fd >= 0) _close(fd);
+#else
+    if (fd >= 0) close(fd);
+#endif
+    return NULL;
+  }
+  ts_parser_print_dot_graphs(self->parser, fd);
+  parser_release(self);
+  Py_RETURN_NONE;
+}
+
+static PyObject *parser_get_collect_stats(Parser *self, void *payload) {
+  return PyBool_FromLong(self->collect_stats);
+}
+
+static int parser_set_collect_stats(Parser *self, PyObject *arg, void *payload) {
+  if (arg == NULL) {
+    PyErr_SetString(PyExc_AttributeError, "Can't delete collect_stats");
+    return -1;
+  }
+  int collect_stats = PyObject_IsTrue(arg);
+  if (collect_stats < 0) return -1;
+  if (parser_acquire(self) < 0) return -1;
+  self->collect_stats = collect_stats;
+  self->has_stats = false;
+  parser_release(self);
+  return 0;
+}
+
+static PyObject *parser_get_last_parse_stats(Parser *self, void *payload) {
+  if (parser_acquire(self) < 0) return NULL;
+  bool has_stats = self->has_stats;
+  ParseStats stats = self->stats;
+  parser_release(self);
+  if (!has_stats) Py_RETURN_NONE;
+  return Py_BuildValue(
+    "{sdsIsIsIsO}",
+    "wall_time", stats.wall_time,
+    "bytes", stats.bytes,
+    "node_count", stats.node_count,
+    "error_count", stats.error_count,
+    "incremental", stats.incremental ? Py_True : Py_False
+  );
+}
+
+static PyObject *parser_get_timeout_micros(Parser *self, void *payload) {
+  return PyLong_FromUnsignedLongLong(ts_parser_timeout_micros(self->parser));
+}
+
+static int parser_set_timeout_micros(Parser *self, PyObject *arg, void *payload) {
+  if (arg == NULL) {
+    PyErr_SetString(PyExc_AttributeError, "Can't delete timeout_micros");
+    return -1;
+  }
+  unsigned long long timeout = PyLong_AsUnsignedLongLong(arg);
+  if (timeout == (unsigned long long)-1 && PyErr_Occurred()) return -1;
+
+  if (parser_acquire(self) < 0) return -1;
+  ts_parser_set_timeout_micros(self->parser, timeout);
+  for (size_t i = 0; i < self->pool_size; i++) {
+    ts_parser_set_timeout_micros(self->pool[i], timeout);
+  }
+  parser_release(self);
+  return 0;
+}
+
+static PyGetSetDef parser_accessors[] = {
+  {
+    "collect_stats",
+    (getter)parser_get_collect_stats,
+    (setter)parser_set_collect_stats,
+    "Whether to record last_parse_stats for each parse, which walks every new tree.",
+    NULL
+  },
+  {
+    "last_parse_stats",
+    (getter)parser_get_last_parse_stats,
+    NULL,
+    "The wall time, bytes, node and error counts of the last parse while collect_stats is set, or None.",
+    NULL
+  },
+  {
+    "included_ranges",
+    (getter)parser_get_included_ranges,
+    NULL,
+    "The ranges of the document that the parser parses, set with set_included_ranges.",
+    NULL
+  },
+  {
+    "timeout_micros",
+    (getter)parser_get_timeout_micros,
+    (setter)parser_set_timeout_micros,
+    "The maximum duration in microseconds that a parse may take before it is halted, or 0 for no limit.",
+    NULL
+  },
+  {NULL}
+};
+
+static PyMethodDef parser_methods[] = {
+  {
+    .ml_name = "parse",
+    .ml_meth = (PyCFunction)parser_parse,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "parse(source, old_tree=None)\n--\n\n\
+               Parse source code, creating a syntax tree.\n\n\
+               The source can be any bytes-like object, or a callable that\n\
+               takes a byte offset and a point and returns the bytes at that\n\
+               position, or None (or empty bytes) at the end of the input.\n\n\
+               When the source is None, the text of an old tree that was\n\
+               edited with new_text is reparsed. The text moves to the new\n\
+               tree instead of being copied, so afterwards the old tree and\n\
+               its nodes have no text. Parse a copy() to keep both.\n\n\
+               Raises TimeoutError if the parse exceeds timeout_micros, and\n\
+               RuntimeError if it is cancelled. Parsing the same source and\n\
+               old tree again resumes the halted parse.",
+  },
+  {
+    .ml_name = "cancel",
+    .ml_meth = (PyCFunction)parser_cancel,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "cancel()\n--\n\n\
+               Halt the parse currently running on this parser, or the next one\n\
+               if none is running. Can be called from any thread.",
+  },
+  {
+    .ml_name = "reset",
+    .ml_meth = (PyCFunction)parser_reset,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "reset()\n--\n\n\
+               Discard any halted parse, so that the next parse starts over.",
+  },
+  {
+    .ml_name = "enable_logging",
+    .ml_meth = (PyCFunction)parser_enable_logging,
+    .ml_flags = METH_VARARGS|METH_KEYWORDS,
+    .ml_doc = "enable_logging(sample=1, max_bytes=1048576)\n--\n\n\
+               Record the parser's log messages in a native buffer, to be read\n\
+               with take_log. Only every sample-th message is kept, and\n\
+               messages are dropped while the buffer holds max_bytes.",
+  },
+  {
+    .ml_name = "disable_logging",
+    .ml_meth = (PyCFunction)parser_disable_logging,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "disable_logging()\n--\n\n\
+               Stop logging and discard the buffered messages.",
+  },
+  {
+    .ml_name = "take_log",
+    .ml_meth = (PyCFunction)parser_take_log,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "take_log()\n--\n\n\
+               Return the buffered log messages as a list of strings, each\n\
+               starting with 'lex: ' or 'parse: ', and empty the buffer.",
+  },
+  {
+    .ml_name = "print_dot_graphs",
+    .ml_meth = (PyCFunction)parser_print_dot_graphs,
+    .ml_flags = METH_O,
+    .ml_doc = "print_dot_graphs(file)\n--\n\n\
+               Write DOT graphs of the parse stack and trees to the given file\n\
+               or file descriptor while parsing, or stop if file is None.",
+  },
+  {
+    .ml_name = "parse_batch",
+    .ml_meth = (PyCFunction)parser_parse_batch,
+    .ml_flags = METH_VARARGS|METH_KEYWORDS,
+    .ml_doc = "parse_batch(sources, threads=None)\n--\n\n\
+               Parse a sequence of bytes objects in parallel, returning a list\n\
+               of syntax trees in the same order. By default, one thread is\n\
+               used per CPU.",
+  },
+  {
+    .ml_name = "set_included_ranges",
+    .ml_meth = (PyCFunction)parser_set_included_ranges,
+    .ml_flags = METH_O,
+    .ml_doc = "set_included_ranges(ranges)\n--\n\n\
+               Restrict parsing to the given ranges of the document, so that\n\
+               embedded code can be parsed in place.\n\n\
+               The ranges can be Range objects, nodes, or the (node, name)\n\
+               tuples returned by Query.captures. They are sorted, and ranges\n\
+               that overlap are merged. An empty sequence includes the whole\n\
+               document.",
+  },
+  {
+    .ml_name = "set_language",
+    .ml_meth = (PyCFunction)parser_set_language,
+    .ml_flags = METH_O,
+    .ml_doc = "set_language(language)\n--\n\n\
+               Set the parser language.",
+  },
+  {NULL},
+};
+
+static PyTypeObject parser_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.Parser",
+  .tp_doc = "A Parser",
+  .tp_basicsize = sizeof(Parser),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_new = parser_new,
+  .tp_dealloc = (destructor)parser_dealloc,
+  .tp_methods = parser_methods,
+  .tp_getset = parser_accessors,
+};
+
+// Query
+
+// Like trees, queries keep one spare cursor so that repeated calls don't
+// allocate, while concurrent or nested executions each get their own.
+static TSQueryCursor *query_take_cursor(Query *self) {
+  TSQueryCursor *cursor = self->cursor;
+  if (cursor) {
+    self->cursor = NULL;
+  } else {
+    cursor = ts_query_cursor_new();
+  }
+  ts_query_cursor_set_match_limit(cursor, self->match_limit);
+  return cursor;
+}
+
+// Record the end of an execution, given whether it exceeded the match limit.
+static void query_finish(Query *self, bool exceeded_match_limit) {
+  self->executions++;
+  self->did_exceed_match_limit = exceeded_match_limit;
+  if (exceeded_match_limit) self->match_limit_exceeded++;
+}
+
+static void query_give_cursor(Query *self, TSQueryCursor *cursor) {
+  if (self->cursor) {
+    ts_query_cursor_delete(cursor);
+  } else {
+    self->cursor = cursor;
+  }
+}
+
+// Query predicates
+
+static uint64_t query_string_hash(const char *string, size_t length) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)string[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static int query_string_set_entry_compare(const void *a, const void *b) {
+  uint64_t left = ((const QueryStringSetEntry *)a)->hash;
+  uint64_t right = ((const QueryStringSetEntry *)b)->hash;
+  return left < right ? -1 : left > right ? 1 : 0;
+}
+
+static bool query_string_set_contains(
+  const QueryPredicate *predicate,
+  const char *string,
+  size_t length
+) {
+  uint64_t hash = query_string_hash(string, length);
+  uint32_t low = 0, high = predicate->string_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (predicate->strings[mid].hash < hash) low = mid + 1;
+    else high = mid;
+  }
+  for (uint32_t i = low; i < predicate->string_count && predicate->strings[i].hash == hash; i++) {
+    const QueryStringSetEntry *entry = &predicate->strings[i];
+    if (entry->length == length && memcmp(entry->string, string, length) == 0) return true;
+  }
+  return false;
+}
+
+static const char *query_predicate_string(Query *self, const TSQueryPredicateStep *step, uint32_t *length) {
+  return ts_query_string_value_for_id(self->query, step->value_id, length);
+}
+
+static int query_predicate_error(Query *self, const char *name, uint32_t pattern_index, const char *message) {
+  PyErr_Format(
+    PyExc_SyntaxError,
+    "Invalid #%s predicate in pattern %u: %s",
+    name,
+    pattern_index,
+    message
+  );
+  return -1;
+}
+
+// Compile a single predicate from the steps between two `Done` steps. Returns
+// 1 if a predicate was added, 0 if the predicate isn't one that the binding
+// evaluates (such as `#set!`), and -1 on error.
+static int query_compile_predicate(
+  Query *self,
+  uint32_t pattern_index,
+  const TSQueryPredicateStep *steps,
+  uint32_t step_count,
+  QueryPredicate *predicate,
+  PyObject *re_compile
+) {
+  if (step_count == 0 || steps[0].type != TSQueryPredicateStepTypeString) return 0;
+
+  uint32_t name_length;
+  const char *name = query_predicate_string(self, &steps[0], &name_length);
+  memset(predicate, 0, sizeof(QueryPredicate));
+  predicate->other_capture_id = UINT32_MAX;
+  if (name_length > 4 && memcmp(name, "not-", 4) == 0) {
+    predicate->negated = true;
+    name += 4;
+    name_length -= 4;
+  }
+
+#define NAME_IS(string) (name_length == sizeof(string) - 1 && memcmp(name, string, name_length) == 0)
+  if (NAME_IS("eq?")) {
+    predicate->kind = QueryPredicateEq;
+  } else if (NAME_IS("match?")) {
+    predicate->kind = QueryPredicateMatch;
+  } else if (NAME_IS("any-of?")) {
+    predicate->kind = QueryPredicateAnyOf;
+  } else {
+    return 0;
+  }
+#undef NAME_IS
+
+  if (step_count < 3) {
+    return query_predicate_error(self, name, pattern_index, "expected at least two arguments");
+  }
+  if (steps[1].type != TSQueryPredicateStepTypeCapture) {
+    return query_predicate_error(self, name, pattern_index, "first argument must be a capture");
+  }
+  predicate->capture_id = steps[1].value_id;
+
+  switch (predicate->kind) {
+    case QueryPredicateEq:
+      if (step_count != 3) {
+        return query_predicate_error(self, name, pattern_index, "expected two arguments");
+      }
+      if (steps[2].type == TSQueryPredicateStepTypeCapture) {
+        predicate->other_capture_id = steps[2].value_id;
+      } else {
+        predicate->string = query_predicate_string(self, &steps[2], &predicate->length);
+      }
+      break;
+
+    case QueryPredicateMatch: {
+      if (step_count != 3 || steps[2].type != TSQueryPredicateStepTypeString) {
+        return query_predicate_error(self, name, pattern_index, "expected a capture and a string");
+      }
+      uint32_t length;
+      const char *pattern = query_predicate_string(self, &steps[2], &length);
+      predicate->regex = PyObject_CallFunction(re_compile, "y#", pattern, (Py_ssize_t)length);
+      if (predicate->regex == NULL) return -1;
+      break;
+    }
+
+    case QueryPredicateAnyOf:
+      predicate->string_count = step_count - 2;
+      predicate->strings = PyMem_Malloc(predicate->string_count * sizeof(QueryStringSetEntry));
+      if (predicate->strings == NULL) {
+        PyErr_NoMemory();
+        return -1;
+      }
+      for (uint32_t i = 0; i < predicate->string_count; i++) {
+        const TSQueryPredicateStep *step = &steps[i + 2];
+        if (step->type != TSQueryPredicateStepTypeString) {
+          PyMem_Free(predicate->strings);
+          predicate->strings = NULL;
+          return query_predicate_error(self, name, pattern_index, "arguments after the capture must be strings");
+        }
+        QueryStringSetEntry *entry = &predicate->strings[i];
+        entry->string = query_predicate_string(self, step, &entry->length);
+        entry->hash = query_string_hash(entry->string, entry->length);
+      }
+      qsort(
+        predicate->strings,
+        predicate->string_count,
+        sizeof(QueryStringSetEntry),
+        query_string_set_entry_compare
+      );
+      break;
+  }
+  return 1;
+}
+
+static void query_free_predicates(Query *self) {
+  if (self->predicates && self->predicate_offsets) {
+    for (uint32_t i = 0; i < self->predicate_offsets[self->pattern_count]; i++) {
+      Py_XDECREF(self->predicates[i].regex);
+      PyMem_Free(self->predicates[i].strings);
+    }
+  }
+  PyMem_Free(self->predicates);
+  PyMem_Free(self->predicate_offsets);
+  self->predicates = NULL;
+  self->predicate_offsets = NULL;
+}
+
+// Precompile the text predicates of every pattern, so that matching only has
+// to compare bytes and run regular expressions that are already compiled.
+static int query_compile_predicates(Query *self) {
+  self->pattern_count = ts_query_pattern_count(self->query);
+  self->predicate_offsets = PyMem_Calloc(self->pattern_count + 1, sizeof(uint32_t));
+  if (self->predicate_offsets == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  PyObject *re_compile = NULL;
+  uint32_t count = 0, capacity = 0;
+  for (uint32_t pattern_index = 0; pattern_index < self->pattern_count; pattern_index++) {
+    self->predicate_offsets[pattern_index] = count;
+    uint32_t step_count;
+    const TSQueryPredicateStep *steps =
+      ts_query_predicates_for_pattern(self->query, pattern_index, &step_count);
+
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < step_count; i++) {
+      if (steps[i].type != TSQueryPredicateStepTypeDone) continue;
+
+      if (count == capacity) {
+        capacity = capacity ? capacity * 2 : 8;
+        QueryPredicate *predicates = PyMem_Realloc(self->predicates, capacity * sizeof(QueryPredicate));
+        if (predicates == NULL) {
+          PyErr_NoMemory();
+          goto error;
+        }
+        self->predicates = predicates;
+      }
+      if (!re_compile) {
+        PyObject *re = PyImport_ImportModule("re");
+        if (re == NULL) goto error;
+        re_compile = PyObject_GetAttrString(re, "compile");
+        Py_DECREF(re);
+        if (re_compile == NULL) goto error;
+      }
+
+      int status = query_compile_predicate(
+        self,
+        pattern_index,
+        &steps[start],
+        i - start,
+        &self->predicates[count],
+        re_compile
+      );
+      if (status < 0) goto error;
+      count += status;
+      start = i + 1;
+    }
+  }
+  self->predicate_offsets[self->pattern_count] = count;
+  Py_XDECREF(re_compile);
+  return 0;
+
+error:
+  Py_XDECREF(re_compile);
+  self->predicate_offsets[self->pattern_count] = count;
+  return -1;
+}
+
+static int query_predicate_test(
+  const QueryPredicate *predicate,
+  TreeText *text,
+  TSNode node,
+  const TSQueryMatch *match
+) {
+  size_t length;
+  const char *node_text = tree_text_for_node(text, node, &length, 0);
+  if (node_text == NULL) return -1;
+
+  switch (predicate->kind) {
+    case QueryPredicateEq:
+      if (predicate->other_capture_id == UINT32_MAX) {
+        return length == predicate->length && memcmp(node_text, predicate->string, length) == 0;
+      }
+      for (uint16_t i = 0; i < match->capture_count; i++) {
+        if (match->captures[i].index == predicate->other_capture_id) {
+          size_t other_length;
+          const char *other_text = tree_text_for_node(
+            text, match->captures[i].node, &other_length, 1
+          );
+          if (other_text == NULL) return -1;
+          return length == other_length && memcmp(node_text, other_text, length) == 0;
+        }
+      }
+      return 1;
+
+    case QueryPredicateMatch: {
+      PyObject *view = PyMemoryView_FromMemory((char *)node_text, length, PyBUF_READ);
+      if (view == NULL) return -1;
+      PyObject *found = PyObject_CallMethod(predicate->regex, "search", "O", view);
+      Py_DECREF(view);
+      if (found == NULL) return -1;
+      int result = found != Py_None;
+      Py_DECREF(found);
+      return result;
+    }
+
+    case QueryPredicateAnyOf:
+      return query_string_set_contains(predicate, node_text, length);
+  }
+  return 1;
+}
+
+static bool query_match_has_capture(const TSQueryMatch *match, uint32_t capture_id) {
+  for (uint16_t i = 0; i < match->capture_count; i++) {
+    if (match->captures[i].index == capture_id) return true;
+  }
+  return false;
+}
+
+// Returns 1 if the match satisfies all of its pattern's predicates, 0 if it
+// doesn't, and -1 on error. Predicates need the tree's text, so checking them
+// without it raises ValueError rather than returning unfiltered matches. A
+// capture that is quantified must satisfy the predicate for
+// every node it captured. A match returned with its captures is still in
+// progress, so when `complete` is given it is set to whether the match had
+// every capture that its predicates refer to.
+static int query_satisfies_predicates(
+  Query *self,
+  const TSQueryMatch *match,
+  PyObject *tree,
+  bool *complete
+) {
+  if (complete) *complete = true;
+  self->matches_examined++;
+  if (!self->predicate_offsets || match->pattern_index >= self->pattern_count) return 1;
+  uint32_t start = self->predicate_offsets[match->pattern_index];
+  uint32_t end = self->predicate_offsets[match->pattern_index + 1];
+  if (start == end) return 1;
+
+  TreeText text;
+  int status = tree_text_acquire((Tree *)tree, &text);
+  if (status < 0) return -1;
+  if (status == 0) {
+    PyErr_SetString(
+      PyExc_ValueError,
+      "Query predicates need the tree's text, which trees parsed from a callback "
+      "or edited without new_text don't have"
+    );
+    return -1;
+  }
+
+  int result = 1;
+  for (uint32_t i = start; i < end && result == 1; i++) {
+    const QueryPredicate *predicate = &self->predicates[i];
+    if (complete && *complete) {
+      *complete = query_match_has_capture(match, predicate->capture_id) &&
+        (predicate->other_capture_id == UINT32_MAX ||
+         query_match_has_capture(match, predicate->other_capture_id));
+    }
+    for (uint16_t j = 0; j < match->capture_count; j++) {
+      const TSQueryCapture *capture = &match->captures[j];
+      if (capture->index != predicate->capture_id) continue;
+      int test = query_predicate_test(predicate, &text, capture->node, match);
+      if (test < 0) {
+        result = -1;
+        break;
+      }
+      if ((bool)test == predicate->negated) {
+        result = 0;
+        break;
+      }
+    }
+  }
+
+  tree_text_release(&text);
+  return result;
+}
+
+// Build a `(pattern_index, {capture_name: node})` tuple for a match. When a
+// capture name occurs more than once in the match, its value is a list of all
+// of the nodes captured under that name.
+static PyObject *query_match_new(
+  Query *self,
+  const TSQueryMatch *match,
+  PyObject *tree,
+  uint32_t pattern_index
+) {
+  PyObject *captures = PyDict_New();
+  if (captures == NULL) return NULL;
+
+  self->captures_emitted += match->capture_count;
+  for (uint16_t i = 0; i < match->capture_count; i++) {
+    const TSQueryCapture *capture = &match->captures[i];
+    PyObject *capture_name = PyList_GET_ITEM(self->capture_names, capture->index);
+    PyObject *capture_node = node_new_internal(capture->node, tree);
+    if (capture_node == NULL) goto error;
+
+    PyObject *existing = PyDict_GetItem(captures, capture_name);
+    int status;
+    if (existing == NULL) {
+      status = PyDict_SetItem(captures, capture_name, capture_node);
+    } else if (PyList_Check(existing)) {
+      status = PyList_Append(existing, capture_node);
+    } else {
+      PyObject *nodes = PyList_New(2);
+      if (nodes == NULL) {
+        Py_DECREF(capture_node);
+        goto error;
+      }
+      Py_INCREF(existing);
+      PyList_SET_ITEM(nodes, 0, existing);
+      Py_INCREF(capture_node);
+      PyList_SET_ITEM(nodes, 1, capture_node);
+      status = PyDict_SetItem(captures, capture_name, nodes);
+      Py_DECREF(nodes);
+    }
+    Py_DECREF(capture_node);
+    if (status < 0) goto error;
+  }
+
+  return Py_BuildValue("(IN)", pattern_index, captures);
+
+error:
+  Py_DECREF(captures);
+  return NULL;
+}
+
+static PyObject *query_iterator_new_internal(Query *query, QueryExecArgs *exec_args, int captures);
+
+// Parse the arguments shared by all of the ways of running a query: the node
+// to search, and optional point and byte ranges to restrict the search to.
+// Only `captures` accepts a list of `ranges`.
+static int query_parse_exec_args(
+  PyObject *const *args,
+  Py_ssize_t nargs,
+  PyObject *kwnames,
+  const char *name,
+  bool allow_ranges,
+  QueryExecArgs *exec_args
+) {
+  static const char *const keywords[] = {
+    "node",
+    "start_point",
+    "end_point",
+    "start_byte",
+    "end_byte",
+    "ranges",
+    NULL,
+  };
+  static const char *const keywords_without_ranges[] = {
+    "node",
+    "start_point",
+    "end_point",
+    "start_byte",
+    "end_byte",
+    NULL,
+  };
+
+  exec_args->node = NULL;
+  exec_args->start_point = (TSPoint) {0, 0};
+  exec_args->end_point = (TSPoint) {UINT32_MAX, UINT32_MAX};
+  exec_args->start_byte = 0;
+  exec_args->end_byte = UINT32_MAX;
+  exec_args->ranges = Py_None;
+  PyObject *values[6] = {NULL};
+  if (parse_fastcall_args(
+    name, args, nargs, kwnames, allow_ranges ? keywords : keywords_without_ranges, 1, values
+  ) < 0) return -1;
+  exec_args->node = (Node *)values[0];
+  PyObject *start_point = values[1], *end_point = values[2];
+  PyObject *start_byte = values[3], *end_byte = values[4];
+  if (values[5]) exec_args->ranges = values[5];
+
+  if (
+    (start_point && start_point != Py_None && point_from_arg(start_point, "start_point", &exec_args->start_point) < 0) ||
+    (end_point && end_point != Py_None && point_from_arg(end_point, "end_point", &exec_args->end_point) < 0) ||
+    (start_byte && start_byte != Py_None && uint32_from_arg(start_byte, &exec_args->start_byte) < 0) ||
+    (end_byte && end_byte != Py_None && uint32_from_arg(end_byte, &exec_args->end_byte) < 0)
+  ) {
+    return -1;
+  }
+
+  if (!node_is_instance((PyObject *)exec_args->node)) {
+    PyErr_Format(PyExc_TypeError, "First argument to %s must be a Node", name);
+    return -1;
+  }
+  if (!tree_check_open(exec_args->node->tree)) return -1;
+  return 0;
+}
+
+// Like `query_satisfies_predicates`, for a match returned by
+// `ts_query_cursor_next_capture` since `checked` was zeroed. A match that
+// doesn't satisfy them is removed from the cursor, so it isn't returned again,
+// and one that does is remembered once it has all the captures they test.
+static int query_capture_satisfies_predicates(
+  Query *self,
+  TSQueryCursor *cursor,
+  const TSQueryMatch *match,
+  PyObject *tree,
+  CheckedMatches *checked
+) {
+  for (uint32_t i = 1; i <= checked->count; i++) {
+    uint32_t slot = (checked->next + CHECKED_MATCH_COUNT - i) % CHECKED_MATCH_COUNT;
+    if (checked->ids[slot] == match->id) return 1;
+  }
+
+  bool complete;
+  int satisfied = query_satisfies_predicates(self, match, tree, &complete);
+  if (satisfied == 0) {
+    ts_query_cursor_remove_match(cursor, match->id);
+  } else if (satisfied == 1 && complete) {
+    checked->ids[checked->next] = match->id;
+    checked->next = (checked->next + 1) % CHECKED_MATCH_COUNT;
+    if (checked->count < CHECKED_MATCH_COUNT) checked->count++;
+  }
+  return satisfied;
+}
+
+// Start executing the query over the node, within the byte range, and within
+// the range given by the caller. Returns false, without executing, when the
+// range is empty: the cursor would take an end byte of 0 to mean the end of
+// the document, and an empty range contains no nodes anyway.
+static bool query_exec(
+  Query *self,
+  TSQueryCursor *cursor,
+  QueryExecArgs *exec_args,
+  uint32_t start_byte,
+  uint32_t end_byte
+) {
+  if (start_byte < exec_args->start_byte) start_byte = exec_args->start_byte;
+  if (end_byte > exec_args->end_byte) end_byte = exec_args->end_byte;
+  if (end_byte <= start_byte) return false;
+  ts_query_cursor_set_byte_range(cursor, start_byte, end_byte);
+  ts_query_cursor_set_point_range(cursor, exec_args->start_point, exec_args->end_point);
+  ts_query_cursor_exec(cursor, self->query, exec_args->node->node);
+  return true;
+}
+
+// Append the matches within the node to `result`. When `query_set` is given,
+// `result` is a list with one list per query in the set instead, and each
+// match goes to the list of the query its pattern came from.
+static int query_collect_matches(
+  Query *self,
+  QueryExecArgs *exec_args,
+  PyObject *result,
+  QuerySet *query_set
+) {
+  Node *node = exec_args->node;
+  TSQueryCursor *cursor = query_take_cursor(self);
+  bool running = query_exec(self, cursor, exec_args, 0, UINT32_MAX);
+
+  int status = 0;
+  TSQueryMatch match;
+  while (running && ts_query_cursor_next_match(cursor, &match)) {
+    int satisfied = query_satisfies_predicates(self, &match, node->tree, NULL);
+    if (satisfied < 0) {
+      status = -1;
+      break;
+    }
+    if (!satisfied) continue;
+    PyObject *list = result;
+    uint32_t pattern_index = match.pattern_index;
+    if (query_set) {
+      uint32_t group = query_set->pattern_groups[pattern_index];
+      list = PyList_GET_ITEM(result, group);
+      pattern_index -= query_set->pattern_offsets[group];
+    }
+    PyObject *item = query_match_new(self, &match, node->tree, pattern_index);
+    if (item == NULL || PyList_Append(list, item) < 0) {
+      Py_XDECREF(item);
+      status = -1;
+      break;
+    }
+    Py_DECREF(item);
+  }
+
+  query_finish(self, running && ts_query_cursor_did_exceed_match_limit(cursor));
+  query_give_cursor(self, cursor);
+  return status;
+}
+
+static PyObject *query_matches(Query *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  QueryExecArgs exec_args;
+  if (query_parse_exec_args(args, nargs, kwnames, "matches", false, &exec_args) < 0) return NULL;
+
+  PyObject *result = PyList_New(0);
+  if (result == NULL) return NULL;
+  if (query_collect_matches(self, &exec_args, result, NULL) < 0) Py_CLEAR(result);
+  return result;
+}
+
+static PyObject *query_iter_matches(Query *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  QueryExecArgs exec_args;
+  if (query_parse_exec_args(args, nargs, kwnames, "iter_matches", false, &exec_args) < 0) return NULL;
+  return query_iterator_new_internal(self, &exec_args, 0);
+}
+
+static PyObject *query_iter_captures(Query *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  QueryExecArgs exec_args;
+  if (query_parse_exec_args(args, nargs, kwnames, "iter_captures", false, &exec_args) < 0) return NULL;
+  return query_iterator_new_internal(self, &exec_args, 1);
+}
+
+static PyObject *capture_arrays_new_internal(
+  Query *query,
+  PyObject *tree,
+  TSNode *nodes,
+  uint32_t *capture_indices,
+  Py_ssize_t length
+);
+
+static PyObject *query_captures_array(Query *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  QueryExecArgs exec_args;
+  if (query_parse_exec_args(args, nargs, kwnames, "captures_array", false, &exec_args) < 0) return NULL;
+  Node *node = exec_args.node;
+
+  TSNode *nodes = NULL;
+  uint32_t *capture_indices = NULL;
+  Py_ssize_t length = 0, capacity = 0;
+  PyObject *result = NULL;
+
+  TSQueryCursor *cursor = query_take_cursor(self);
+  bool running = query_exec(self, cursor, &exec_args, 0, UINT32_MAX);
+
+  uint32_t capture_index;
+  TSQueryMatch match;
+  CheckedMatches checked = {0};
+  while (running && ts_query_cursor_next_capture(cursor, &match, &capture_index)) {
+    int satisfied = query_capture_satisfies_predicates(self, cursor, &match, node->tree, &checked);
+    if (satisfied < 0) goto exit;
+    if (!satisfied) continue;
+
+    if (length == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      TSNode *new_nodes = PyMem_Realloc(nodes, capacity * sizeof(TSNode));
+      if (new_nodes) nodes = new_nodes;
+      uint32_t *new_indices = PyMem_Realloc(capture_indices, capacity * sizeof(uint32_t));
+      if (new_indices) capture_indices = new_indices;
+      if (!new_nodes || !new_indices) {
+        PyErr_NoMemory();
+        goto exit;
+      }
+    }
+    nodes[length] = match.captures[capture_index].node;
+    capture_indices[length] = match.captures[capture_index].index;
+    length++;
+  }
+
+  self->captures_emitted += length;
+  query_finish(self, running && ts_query_cursor_did_exceed_match_limit(cursor));
+  result = capture_arrays_new_internal(self, node->tree, nodes, capture_indices, length);
+  nodes = NULL;
+
+exit:
+  query_give_cursor(self, cursor);
+  PyMem_Free(nodes);
+  PyMem_Free(capture_indices);
+  return result;
+}
+
+// Append the captures found by an executing cursor to `result`, or to the
+// list in `result` of the query each capture's pattern came from when
+// `query_set` is given.
+static int query_collect_captures(
+  Query *self,
+  TSQueryCursor *cursor,
+  PyObject *tree,
+  PyObject *result,
+  QuerySet *query_set
+) {
+  uint32_t capture_index;
+  TSQueryMatch match;
+  CheckedMatches checked = {0};
+  while (ts_query_cursor_next_capture(cursor, &match, &capture_index)) {
+    int satisfied = query_capture_satisfies_predicates(self, cursor, &match, tree, &checked);
+    if (satisfied < 0) return -1;
+    if (!satisfied) continue;
+    const TSQueryCapture *capture = &match.captures[capture_index];
+    PyObject *capture_node = node_new_internal(capture->node, tree);
+    if (capture_node == NULL) return -1;
+    PyObject *capture_name = PyList_GET_ITEM(self->capture_names, capture->index);
+    PyObject *item = PyTuple_Pack(2, capture_node, capture_name);
+    Py_DECREF(capture_node);
+    if (item == NULL) return -1;
+    PyObject *list = result;
+    if (query_set) list = PyList_GET_ITEM(result, query_set->pattern_groups[match.pattern_index]);
+    int status = PyList_Append(list, item);
+    Py_DECREF(item);
+    if (status < 0) return -1;
+    self->captures_emitted++;
+  }
+  return 0;
+}
+
+// Append the captures within the node, and within the ranges if any are
+// given, to `result`, as `query_collect_captures` does.
+static int query_collect_captures_in_ranges(
+  Query *self,
+  QueryExecArgs *exec_args,
+  PyObject *result,
+  QuerySet *query_set
+) {
+  Node *node = exec_args->node;
+  PyObject *ranges_arg = exec_args->ranges;
+
+  TSQueryCursor *cursor = query_take_cursor(self);
+  if (ranges_arg == Py_None) {
+    int status = 0;
+    bool running = query_exec(self, cursor, exec_args, 0, UINT32_MAX);
+    if (running) {
+      status = query_collect_captures(self, cursor, node->tree, result, query_set);
+    }
+    query_finish(self, running && ts_query_cursor_did_exceed_match_limit(cursor));
+    query_give_cursor(self, cursor);
+    return status;
+  }
+
+  // Restrict the query to each of the given ranges in turn, in document order,
+  // after merging the ranges that overlap. A node that extends past a range
+  // is found again from the next one; the caller deals with those repeats.
+  PyObject *ranges = PySequence_List(ranges_arg);
+  TSRange *sorted = NULL;
+  Py_ssize_t range_count = ranges ? PyList_GET_SIZE(ranges) : 0;
+  if (ranges) {
+    sorted = PyMem_Malloc((range_count + 1) * sizeof(TSRange));
+    if (!sorted) PyErr_NoMemory();
+  }
+  if (!sorted) goto range_exit;
+
+  for (Py_ssize_t i = 0; i < range_count; i++) {
+    PyObject *range = PyList_GET_ITEM(ranges, i);
+    if (!range_is_instance(range)) {
+      PyErr_SetString(PyExc_TypeError, "Ranges must be a sequence of Range objects");
+      goto range_exit;
+    }
+    sorted[i] = ((Range *)range)->range;
+  }
+  qsort(sorted, range_count, sizeof(TSRange), included_range_compare);
+  Py_ssize_t merged_count = 0;
+  for (Py_ssize_t i = 0; i < range_count; i++) {
+    if (merged_count > 0 && sorted[i].start_byte <= sorted[merged_count - 1].end_byte) {
+      if (sorted[i].end_byte > sorted[merged_count - 1].end_byte) {
+        sorted[merged_count - 1].end_byte = sorted[i].end_byte;
+      }
+    } else {
+      sorted[merged_count++] = sorted[i];
+    }
+  }
+
+  bool exceeded_match_limit = false;
+  for (Py_ssize_t i = 0; i < merged_count; i++) {
+    if (!query_exec(self, cursor, exec_args, sorted[i].start_byte, sorted[i].end_byte)) {
+      continue;
+    }
+    if (query_collect_captures(self, cursor, node->tree, result, query_set) < 0) {
+      goto range_exit;
+    }
+    if (ts_query_cursor_did_exceed_match_limit(cursor)) exceeded_match_limit = true;
+  }
+  query_finish(self, exceeded_match_limit);
+
+  PyMem_Free(sorted);
+  Py_DECREF(ranges);
+  query_give_cursor(self, cursor);
+  return 0;
+
+range_exit:
+  PyMem_Free(sorted);
+  Py_XDECREF(ranges);
+  query_give_cursor(self, cursor);
+  return -1;
+}
+
+static PyObject *query_captures(Query *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  QueryExecArgs exec_args;
+  if (query_parse_exec_args(args, nargs, kwnames, "captures", true, &exec_args) < 0) return NULL;
+
+  PyObject *result = PyList_New(0);
+  if (result == NULL) return NULL;
+  if (query_collect_captures_in_ranges(self, &exec_args, result, NULL) < 0) Py_CLEAR(result);
+  return result;
+}
+
+static void query_dealloc(Query *self) {
+  query_free_predicates(self);
+  if (self->cursor) ts_query_cursor_delete(self->cursor);
+  if (self->query) ts_query_delete(self->query);
+  Py_XDECREF(self->source);
+  Py_XDECREF(self->capture_names);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *query_reset_stats(Query *self, PyObject *args) {
+  self->executions = 0;
+  self->matches_examined = 0;
+  self->captures_emitted = 0;
+  self->match_limit_exceeded = 0;
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef query_methods[] = {
+  {
+    .ml_name = "matches",
+    .ml_meth = (PyCFunction)query_matches,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "matches(node, start_point=None, end_point=None, start_byte=None, end_byte=None)\n--\n\n\
+               Get a list of all of the matches within the given node.\n\n\
+               Each match is a tuple of the pattern index and a dict mapping\n\
+               capture names to nodes, or to lists of nodes for capture names\n\
+               that occur more than once in the match."
+  },
+  {
+    .ml_name = "iter_matches",
+    .ml_meth = (PyCFunction)query_iter_matches,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "iter_matches(node, start_point=None, end_point=None, start_byte=None, end_byte=None)\n--\n\n\
+               Iterate over the matches within the given node, one at a time."
+  },
+  {
+    .ml_name = "iter_captures",
+    .ml_meth = (PyCFunction)query_iter_captures,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "iter_captures(node, start_point=None, end_point=None, start_byte=None, end_byte=None)\n--\n\n\
+               Iterate over the captures within the given node, one at a time."
+  },
+  {
+    .ml_name = "captures_array",
+    .ml_meth = (PyCFunction)query_captures_array,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "captures_array(node, start_point=None, end_point=None, start_byte=None, end_byte=None)\n--\n\n\
+               Get all of the captures within the given node as CaptureArrays,\n\
+               a set of parallel arrays of capture indices, positions and node\n\
+               symbols that support the buffer protocol."
+  },
+  {
+    .ml_name = "captures",
+    .ml_meth = (PyCFunction)query_captures,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "captures(node, start_point=None, end_point=None, start_byte=None, end_byte=None, ranges=None)\n--\n\n\
+               Get a list of all of the captures within the given node.\n\n\
+               The start and end points and bytes restrict the search to nodes\n\
+               that intersect that part of the document.\n\n\
+               If ranges is given, only captures of nodes that intersect one\n\
+               of those ranges are returned, such as the changed ranges of an\n\
+               incrementally reparsed tree. Overlapping ranges are merged, but\n\
+               a node that extends across several separate ranges is captured\n\
+               once for each of them, and the captures are not merged with any\n\
+               found before the reparse; both are left to the caller.",
+  },
+  {
+    .ml_name = "reset_stats",
+    .ml_meth = (PyCFunction)query_reset_stats,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "reset_stats()\n--\n\n\
+               Set the counters in stats back to zero.",
+  },
+  {NULL},
+};
+
+static PyObject *query_get_match_limit(Query *self, void *payload) {
+  return PyLong_FromUnsignedLong(self->match_limit);
+}
+
+static int query_set_match_limit(Query *self, PyObject *value, void *payload) {
+  if (value == NULL) {
+    PyErr_SetString(PyExc_AttributeError, "Cannot delete match_limit");
+    return -1;
+  }
+  unsigned long limit = PyLong_AsUnsignedLong(value);
+  if (limit == (unsigned long)-1 && PyErr_Occurred()) return -1;
+  if (limit == 0 || limit > UINT32_MAX) {
+    PyErr_SetString(PyExc_ValueError, "match_limit must be between 1 and 2**32 - 1");
+    return -1;
+  }
+  self->match_limit = (uint32_t)limit;
+  return 0;
+}
+
+static PyObject *query_get_source(Query *self, void *payload) {
+  Py_INCREF(self->source);
+  return self->source;
+}
+
+static PyObject *query_get_did_exceed_match_limit(Query *self, void *payload) {
+  return PyBool_FromLong(self->did_exceed_match_limit);
+}
+
+static PyObject *query_get_stats(Query *self, void *payload) {
+  return Py_BuildValue(
+    "{sKsKsKsK}",
+    "executions", (unsigned long long)self->executions,
+    "matches_examined", (unsigned long long)self->matches_examined,
+    "captures_emitted", (unsigned long long)self->captures_emitted,
+    "match_limit_exceeded", (unsigned long long)self->match_limit_exceeded
+  );
+}
+
+static PyObject *query_get_pattern_count(Query *self, void *payload) {
+  return PyLong_FromUnsignedLong(self->pattern_count);
+}
+
+static PyGetSetDef query_accessors[] = {
+  {"source", (getter)query_get_source, NULL, "The source code this query was created from, as bytes.", NULL},
+  {"pattern_count", (getter)query_get_pattern_count, NULL, "The number of patterns in this query.", NULL},
+  {
+    "did_exceed_match_limit",
+    (getter)query_get_did_exceed_match_limit,
+    NULL,
+    "Whether the most recent execution of this query dropped matches because of match_limit.",
+    NULL
+  },
+  {
+    "stats",
+    (getter)query_get_stats,
+    NULL,
+    "Counts of the work done by this query's executions, as a dict.",
+    NULL
+  },
+  {
+    "match_limit",
+    (getter)query_get_match_limit,
+    (setter)query_set_match_limit,
+    "The maximum number of in-progress matches a query execution may track.",
+    NULL
+  },
+  {NULL}
 };
 
-static PyTypeObject tree_cursor_type = {
+static PyTypeObject query_type = {
   PyVarObject_HEAD_INIT(NULL, 0)
-  .tp_name = "tree_sitter.TreeCursor",
-  .tp_doc = "A syntax tree cursor.",
-  .tp_basicsize = sizeof(TreeCursor),
+  .tp_name = "tree_sitter.Query",
+  .tp_doc = "A set of patterns to search for in a syntax tree.",
+  .tp_basicsize = sizeof(Query),
   .tp_itemsize = 0,
   .tp_flags = Py_TPFLAGS_DEFAULT,
-  .tp_dealloc = (destructor)tree_cursor_dealloc,
-  .tp_methods = tree_cursor_methods,
-  .tp_getset = tree_cursor_accessors,
+  .tp_dealloc = (destructor)query_dealloc,
+  .tp_methods = query_methods,
+  .tp_getset = query_accessors,
 };
 
-static PyObject *tree_cursor_new_internal(TSNode node, PyObject *tree) {
-  TreeCursor *self = (TreeCursor *)tree_cursor_type.tp_alloc(&tree_cursor_type, 0);
-  if (self != NULL) {
-    self->cursor = ts_tree_cursor_new(node);
-    Py_INCREF(tree);
-    self->tree = tree;
+// QueryIterator
+
+static void query_iterator_dealloc(QueryIterator *self) {
+  if (self->cursor) query_give_cursor(self->query, self->cursor);
+  Py_XDECREF(self->query);
+  Py_XDECREF(self->tree);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *query_iterator_next(QueryIterator *self) {
+  if (self->cursor == NULL) return NULL;
+  if (!tree_check_open(self->tree)) return NULL;
+
+  Query *query = self->query;
+  TSQueryMatch match;
+  PyObject *result = NULL;
+  if (self->captures) {
+    uint32_t capture_index;
+    while (ts_query_cursor_next_capture(self->cursor, &match, &capture_index)) {
+      int satisfied = query_capture_satisfies_predicates(
+        query, self->cursor, &match, self->tree, &self->checked
+      );
+      if (satisfied < 0) return NULL;
+      if (!satisfied) continue;
+      const TSQueryCapture *capture = &match.captures[capture_index];
+      PyObject *capture_node = node_new_internal(capture->node, self->tree);
+      if (capture_node == NULL) return NULL;
+      PyObject *capture_name = PyList_GET_ITEM(query->capture_names, capture->index);
+      result = PyTuple_Pack(2, capture_node, capture_name);
+      Py_DECREF(capture_node);
+      if (result) query->captures_emitted++;
+      return result;
+    }
+  } else {
+    while (ts_query_cursor_next_match(self->cursor, &match)) {
+      int satisfied = query_satisfies_predicates(query, &match, self->tree, NULL);
+      if (satisfied < 0) return NULL;
+      if (satisfied) return query_match_new(query, &match, self->tree, match.pattern_index);
+    }
   }
-  return (PyObject *)self;
+
+  // Exhausted, so the cursor can go back to the query right away.
+  query_finish(query, ts_query_cursor_did_exceed_match_limit(self->cursor));
+  query_give_cursor(query, self->cursor);
+  self->cursor = NULL;
+  return NULL;
 }
 
-// Parser
+static PyTypeObject query_iterator_type = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "tree_sitter.QueryIterator",
+  .tp_doc = "An iterator over the matches or captures of a query.",
+  .tp_basicsize = sizeof(QueryIterator),
+  .tp_itemsize = 0,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor)query_iterator_dealloc,
+  .tp_iter = PyObject_SelfIter,
+  .tp_iternext = (iternextfunc)query_iterator_next,
+};
 
-static PyObject *parser_new(
-  PyTypeObject *type,
-  PyObject *args,
-  PyObject *kwds
-) {
-  Parser *self = (Parser *)type->tp_alloc(type, 0);
-  if (self != NULL) self->parser = ts_parser_new();
+static PyObject *query_iterator_new_internal(Query *query, QueryExecArgs *exec_args, int captures) {
+  QueryIterator *self = (QueryIterator *)query_iterator_type.tp_alloc(&query_iterator_type, 0);
+  if (self == NULL) return NULL;
+  Py_INCREF(query);
+  self->query = query;
+  Py_INCREF(exec_args->node->tree);
+  self->tree = exec_args->node->tree;
+  self->captures = captures;
+  self->cursor = query_take_cursor(query);
+  if (!query_exec(query, self->cursor, exec_args, 0, UINT32_MAX)) {
+    query_finish(query, false);
+    query_give_cursor(query, self->cursor);
+    self->cursor = NULL;
+  }
   return (PyObject *)self;
 }
 
-static void parser_dealloc(Parser *self) {
-  ts_parser_delete(self->parser);
-  Py_TYPE(self)->tp_free((PyObject *)self);
-}
+// QuerySet
 
-static PyObject *parser_parse(Parser *self, PyObject *args) {
-  PyObject *source_code = NULL;
-  PyObject *old_tree_arg = NULL;
-  if (!PyArg_UnpackTuple(args, "ref", 1, 2, &source_code, &old_tree_arg)) {
+// A query set runs several queries in a single traversal: their patterns are
+// compiled together into one query, and the results of each pattern are
+// handed back to the query it came from.
+static PyObject *query_set_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+  static char *keywords[] = {"query", "pattern_counts", NULL};
+  Query *query;
+  PyObject *pattern_counts_arg;
+  if (!PyArg_ParseTupleAndKeywords(
+    args, kwargs, "O!O:QuerySet", keywords, &query_type, &query, &pattern_counts_arg
+  )) {
     return NULL;
   }
 
-  if (!PyBytes_Check(source_code)) {
-    PyErr_SetString(PyExc_TypeError, "First argument to parse must be bytes");
+  PyObject *pattern_counts = PySequence_Fast(pattern_counts_arg, "pattern_counts must be a sequence");
+  if (pattern_counts == NULL) return NULL;
+  Py_ssize_t query_count = PySequence_Fast_GET_SIZE(pattern_counts);
+
+  QuerySet *self = (QuerySet *)type->tp_alloc(type, 0);
+  if (self == NULL) {
+    Py_DECREF(pattern_counts);
     return NULL;
   }
+  Py_INCREF(query);
+  self->query = query;
+  self->query_count = (uint32_t)query_count;
+  self->pattern_groups = PyMem_Malloc((query->pattern_count + 1) * sizeof(uint32_t));
+  self->pattern_offsets = PyMem_Malloc((query_count + 1) * sizeof(uint32_t));
+  if (!self->pattern_groups || !self->pattern_offsets) {
+    PyErr_NoMemory();
+    goto error;
+  }
 
-  const TSTree *old_tree = NULL;
-  if (old_tree_arg) {
-    if (!PyObject_IsInstance(old_tree_arg, (PyObject *)&tree_type)) {
-      PyErr_SetString(PyExc_TypeError, "Second argument to parse must be a Tree");
-      return NULL;
+  uint32_t pattern_index = 0;
+  for (Py_ssize_t i = 0; i < query_count; i++) {
+    uint32_t count;
+    if (uint32_from_arg(PySequence_Fast_GET_ITEM(pattern_counts, i), &count) < 0) goto error;
+    if (count > query->pattern_count - pattern_index) break;
+    self->pattern_offsets[i] = pattern_index;
+    for (uint32_t j = 0; j < count; j++) {
+      self->pattern_groups[pattern_index++] = (uint32_t)i;
     }
-
-    old_tree = ((Tree *)old_tree_arg)->tree;
+  }
+  if (pattern_index != query->pattern_count) {
+    PyErr_Format(
+      PyExc_ValueError,
+      "pattern_counts must add up to the query's %u patterns",
+      query->pattern_count
+    );
+    goto error;
   }
 
-  size_t length = PyBytes_Size(source_code);
-  char *source_bytes = PyBytes_AsString(source_code);
-  TSTree *new_tree = ts_parser_parse_string(self->parser, old_tree, source_bytes, length);
+  Py_DECREF(pattern_counts);
+  return (PyObject *)self;
 
-  if (!new_tree) {
-    PyErr_SetString(PyExc_ValueError, "Parsing failed");
-    return NULL;
-  }
+error:
+  Py_DECREF(pattern_counts);
+  Py_DECREF(self);
+  return NULL;
+}
 
-  return tree_new_internal(new_tree, source_code);
+static void query_set_dealloc(QuerySet *self) {
+  PyMem_Free(self->pattern_groups);
+  PyMem_Free(self->pattern_offsets);
+  Py_XDECREF(self->query);
+  Py_TYPE(self)->tp_free(self);
 }
 
-static PyObject *parser_set_language(Parser *self, PyObject *arg) {
-  PyObject *language_id = PyObject_GetAttrString(arg, "language_id");
-  if (!language_id) {
-    PyErr_SetString(PyExc_TypeError, "Argument to set_language must be a Language");
-    return NULL;
+static PyObject *query_set_new_result(QuerySet *self) {
+  PyObject *result = PyList_New(self->query_count);
+  if (result == NULL) return NULL;
+  for (uint32_t i = 0; i < self->query_count; i++) {
+    PyObject *list = PyList_New(0);
+    if (list == NULL) {
+      Py_DECREF(result);
+      return NULL;
+    }
+    PyList_SET_ITEM(result, i, list);
   }
+  return result;
+}
 
-  if (!PyLong_Check(language_id)) {
-    PyErr_SetString(PyExc_TypeError, "Language ID must be an integer");
-    return NULL;
-  }
+static PyObject *query_set_matches(QuerySet *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  QueryExecArgs exec_args;
+  if (query_parse_exec_args(args, nargs, kwnames, "matches", false, &exec_args) < 0) return NULL;
 
-  TSLanguage *language = (TSLanguage *)PyLong_AsVoidPtr(language_id);
-  Py_XDECREF(language_id);
-  if (!language) {
-    PyErr_SetString(PyExc_ValueError, "Language ID must not be null");
-    return NULL;
-  }
+  PyObject *result = query_set_new_result(self);
+  if (result == NULL) return NULL;
+  if (query_collect_matches(self->query, &exec_args, result, self) < 0) Py_CLEAR(result);
+  return result;
+}
 
-  unsigned version = ts_language_version(language);
-  if (version < TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION || TREE_SITTER_LANGUAGE_VERSION < version) {
-    return PyErr_Format(
-      PyExc_ValueError,
-      "Incompatible Language version %u. Must be between %u and %u",
-      version,
-      TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION,
-      TREE_SITTER_LANGUAGE_VERSION
-    );
-  }
+static PyObject *query_set_captures(QuerySet *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  QueryExecArgs exec_args;
+  if (query_parse_exec_args(args, nargs, kwnames, "captures", true, &exec_args) < 0) return NULL;
 
-  ts_parser_set_language(self->parser, language);
-  Py_RETURN_NONE;
+  PyObject *result = query_set_new_result(self);
+  if (result == NULL) return NULL;
+  if (query_collect_captures_in_ranges(self->query, &exec_args, result, self) < 0) Py_CLEAR(result);
+  return result;
 }
 
-static PyMethodDef parser_methods[] = {
+static PyMethodDef query_set_methods[] = {
   {
-    .ml_name = "parse",
-    .ml_meth = (PyCFunction)parser_parse,
-    .ml_flags = METH_VARARGS,
-    .ml_doc = "parse(bytes, old_tree=None)\n--\n\n\
-               Parse source code, creating a syntax tree.",
+    .ml_name = "matches",
+    .ml_meth = (PyCFunction)query_set_matches,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "matches(node, start_point=None, end_point=None, start_byte=None, end_byte=None)\n--\n\n\
+               Get the matches of every query within the given node.\n\n\
+               Returns one list per query, in the order of the queries. Each\n\
+               match's pattern index is the index within its own query."
   },
   {
-    .ml_name = "set_language",
-    .ml_meth = (PyCFunction)parser_set_language,
-    .ml_flags = METH_O,
-    .ml_doc = "set_language(language)\n--\n\n\
-               Set the parser language.",
+    .ml_name = "captures",
+    .ml_meth = (PyCFunction)query_set_captures,
+    .ml_flags = METH_FASTCALL|METH_KEYWORDS,
+    .ml_doc = "captures(node, start_point=None, end_point=None, start_byte=None, end_byte=None, ranges=None)\n--\n\n\
+               Get the captures of every query within the given node.\n\n\
+               Returns one list per query, in the order of the queries, each\n\
+               holding the same captures that the query's own `captures` would."
   },
   {NULL},
 };
 
-static PyTypeObject parser_type = {
+static PyObject *query_set_get_query(QuerySet *self, void *payload) {
+  Py_INCREF(self->query);
+  return (PyObject *)self->query;
+}
+
+static PyObject *query_set_get_query_count(QuerySet *self, void *payload) {
+  return PyLong_FromUnsignedLong(self->query_count);
+}
+
+static PyGetSetDef query_set_accessors[] = {
+  {"query", (getter)query_set_get_query, NULL, "The combined query holding the patterns of every query.", NULL},
+  {"query_count", (getter)query_set_get_query_count, NULL, "The number of queries in this set.", NULL},
+  {NULL}
+};
+
+static PyTypeObject query_set_type = {
   PyVarObject_HEAD_INIT(NULL, 0)
-  .tp_name = "tree_sitter.Parser",
-  .tp_doc = "A Parser",
-  .tp_basicsize = sizeof(Parser),
+  .tp_name = "tree_sitter.QuerySet",
+  .tp_doc = "Several queries that run together in a single traversal.",
+  .tp_basicsize = sizeof(QuerySet),
   .tp_itemsize = 0,
   .tp_flags = Py_TPFLAGS_DEFAULT,
-  .tp_new = parser_new,
-  .tp_dealloc = (destructor)parser_dealloc,
-  .tp_methods = parser_methods,
+  .tp_new = query_set_new,
+  .tp_dealloc = (destructor)query_set_dealloc,
+  .tp_methods = query_set_methods,
+  .tp_getset = query_set_accessors,
 };
 
-// Query
+// CaptureArrays
 
-static PyObject *query_matches(Query *self, PyObject *args) {
-  PyErr_SetString(PyExc_NotImplementedError, "Not Implemented");
-  return NULL;
+static void capture_arrays_dealloc(CaptureArrays *self) {
+  PyMem_Free(self->nodes);
+  Py_XDECREF(self->tree);
+  Py_XDECREF(self->capture_names);
+  Py_XDECREF(self->capture_index);
+  Py_XDECREF(self->start_byte);
+  Py_XDECREF(self->end_byte);
+  Py_XDECREF(self->start_row);
+  Py_XDECREF(self->start_column);
+  Py_XDECREF(self->end_row);
+  Py_XDECREF(self->end_column);
+  Py_XDECREF(self->symbol);
+  Py_TYPE(self)->tp_free(self);
 }
 
-static PyObject *query_captures(Query *self, PyObject *args, PyObject *kwargs) {
-  char *keywords[] = {
-    "node",
-    "start_point",
-    "end_point",
-    NULL,
-  };
-
-  Node *node = NULL;
-  unsigned start_row = 0, start_column = 0, end_row = 0, end_column = 0;
-
-  int ok = PyArg_ParseTupleAndKeywords(
-    args,
-    kwargs,
-    "O|(II)(II)",
-    keywords,
-    (PyObject **)&node,
-    &start_row,
-    &start_column,
-    &end_row,
-    &end_column
-  );
-  if (!ok) return NULL;
+static Py_ssize_t capture_arrays_length(CaptureArrays *self) {
+  return self->length;
+}
 
-  if (!PyObject_IsInstance((PyObject *)node, (PyObject *)&node_type)) {
-    PyErr_SetString(PyExc_TypeError, "First argument to captures must be a Node");
+static PyObject *capture_arrays_node(CaptureArrays *self, PyObject *args) {
+  Py_ssize_t index;
+  if (!PyArg_ParseTuple(args, "n", &index)) return NULL;
+  if (index < 0) index += self->length;
+  if (index < 0 || index >= self->length) {
+    PyErr_SetString(PyExc_IndexError, "Capture index out of range");
     return NULL;
   }
-
-  if (!query_cursor) query_cursor = ts_query_cursor_new();
-  ts_query_cursor_exec(query_cursor, self->query, node->node);
-
-  PyObject *result = PyList_New(0);
-
-  uint32_t capture_index;
-  TSQueryMatch match;
-  while (ts_query_cursor_next_capture(query_cursor, &match, &capture_index)) {
-    const TSQueryCapture *capture = &match.captures[capture_index];
-    PyObject *capture_node = node_new_internal(capture->node, node->tree);
-    PyObject *capture_name = PyList_GetItem(self->capture_names, capture->index);
-    PyObject *item = PyTuple_Pack(2, capture_node, capture_name);
-    Py_XDECREF(capture_node);
-    PyList_Append(result, item);
-    Py_XDECREF(item);
-  }
-
-  return result;
+  return node_new_internal(self->nodes[index], self->tree);
 }
 
-static void query_dealloc(Query *self) {
-  if (self->query) ts_query_delete(self->query);
-  Py_XDECREF(self->capture_names);
-  Py_TYPE(self)->tp_free(self);
-}
-
-static PyMethodDef query_methods[] = {
+static PyMethodDef capture_arrays_methods[] = {
   {
-    .ml_name = "matches",
-    .ml_meth = (PyCFunction)query_matches,
+    .ml_name = "node",
+    .ml_meth = (PyCFunction)capture_arrays_node,
     .ml_flags = METH_VARARGS,
-    .ml_doc = "matches(node)\n--\n\n\
-               Get a list of all of the matches within the given node."
-  },
-  {
-    .ml_name = "captures",
-    .ml_meth = (PyCFunction)query_captures,
-    .ml_flags = METH_KEYWORDS|METH_VARARGS,
-    .ml_doc = "captures(node)\n--\n\n\
-               Get a list of all of the captures within the given node.",
+    .ml_doc = "node(index)\n--\n\n\
+               Get the captured node at the given index.",
   },
   {NULL},
 };
 
-static PyTypeObject query_type = {
+static PyMemberDef capture_arrays_members[] = {
+  {"capture_names", T_OBJECT, offsetof(CaptureArrays, capture_names), READONLY, "The query's capture names, indexed by capture_index"},
+  {"capture_index", T_OBJECT, offsetof(CaptureArrays, capture_index), READONLY, "The capture index of each capture (uint32)"},
+  {"start_byte", T_OBJECT, offsetof(CaptureArrays, start_byte), READONLY, "The start byte of each captured node (uint32)"},
+  {"end_byte", T_OBJECT, offsetof(CaptureArrays, end_byte), READONLY, "The end byte of each captured node (uint32)"},
+  {"start_row", T_OBJECT, offsetof(CaptureArrays, start_row), READONLY, "The start row of each captured node (uint32)"},
+  {"start_column", T_OBJECT, offsetof(CaptureArrays, start_column), READONLY, "The start column of each captured node (uint32)"},
+  {"end_row", T_OBJECT, offsetof(CaptureArrays, end_row), READONLY, "The end row of each captured node (uint32)"},
+  {"end_column", T_OBJECT, offsetof(CaptureArrays, end_column), READONLY, "The end column of each captured node (uint32)"},
+  {"symbol", T_OBJECT, offsetof(CaptureArrays, symbol), READONLY, "The symbol id of each captured node (uint16)"},
+  {NULL}
+};
+
+static PySequenceMethods capture_arrays_sequence_methods = {
+  .sq_length = (lenfunc)capture_arrays_length,
+};
+
+static PyTypeObject capture_arrays_type = {
   PyVarObject_HEAD_INIT(NULL, 0)
-  .tp_name = "tree_sitter.Query",
-  .tp_doc = "A set of patterns to search for in a syntax tree.",
-  .tp_basicsize = sizeof(Query),
+  .tp_name = "tree_sitter.CaptureArrays",
+  .tp_doc = "Query captures stored as parallel arrays.",
+  .tp_basicsize = sizeof(CaptureArrays),
   .tp_itemsize = 0,
   .tp_flags = Py_TPFLAGS_DEFAULT,
-  .tp_dealloc = (destructor)query_dealloc,
-  .tp_methods = query_methods,
+  .tp_dealloc = (destructor)capture_arrays_dealloc,
+  .tp_as_sequence = &capture_arrays_sequence_methods,
+  .tp_methods = capture_arrays_methods,
+  .tp_members = capture_arrays_members,
 };
 
+// Takes ownership of `nodes`.
+static PyObject *capture_arrays_new_internal(
+  Query *query,
+  PyObject *tree,
+  TSNode *nodes,
+  uint32_t *capture_indices,
+  Py_ssize_t length
+) {
+  CaptureArrays *self = (CaptureArrays *)capture_arrays_type.tp_alloc(&capture_arrays_type, 0);
+  if (self == NULL) {
+    PyMem_Free(nodes);
+    return NULL;
+  }
+  self->nodes = nodes;
+  self->length = length;
+  Py_INCREF(tree);
+  self->tree = tree;
+  Py_INCREF(query->capture_names);
+  self->capture_names = query->capture_names;
+
+  uint32_t *columns[7];
+  uint16_t *symbols;
+  PyObject **targets[7] = {
+    &self->capture_index,
+    &self->start_byte,
+    &self->end_byte,
+    &self->start_row,
+    &self->start_column,
+    &self->end_row,
+    &self->end_column,
+  };
+  PyObject *raw[8] = {NULL};
+  for (int i = 0; i < 7; i++) {
+    raw[i] = column_new(length, sizeof(uint32_t), (void **)&columns[i]);
+    if (raw[i] == NULL) goto error;
+  }
+  raw[7] = column_new(length, sizeof(uint16_t), (void **)&symbols);
+  if (raw[7] == NULL) goto error;
+
+  for (Py_ssize_t i = 0; i < length; i++) {
+    TSNode node = nodes[i];
+    TSPoint start_point = ts_node_start_point(node);
+    TSPoint end_point = ts_node_end_point(node);
+    columns[0][i] = capture_indices[i];
+    columns[1][i] = ts_node_start_byte(node);
+    columns[2][i] = ts_node_end_byte(node);
+    columns[3][i] = start_point.row;
+    columns[4][i] = start_point.column;
+    columns[5][i] = end_point.row;
+    columns[6][i] = end_point.column;
+    symbols[i] = ts_node_symbol(node);
+  }
+
+  for (int i = 0; i < 7; i++) {
+    *targets[i] = column_view(raw[i], "I");
+    raw[i] = NULL;
+    if (*targets[i] == NULL) goto error;
+  }
+  self->symbol = column_view(raw[7], "H");
+  raw[7] = NULL;
+  if (self->symbol == NULL) goto error;
+  return (PyObject *)self;
+
+error:
+  for (int i = 0; i < 8; i++) Py_XDECREF(raw[i]);
+  Py_DECREF(self);
+  return NULL;
+}
+
 static PyObject *query_new_internal(
   TSLanguage *language,
   char *source,
@@ -840,6 +5482,13 @@ static PyObject *query_new_internal(
 ) {
   Query *query = (Query *)query_type.tp_alloc(&query_type, 0);
   if (query == NULL) return NULL;
+  query->match_limit = UINT32_MAX;
+  query->language = language;
+  query->source = PyBytes_FromStringAndSize(source, length);
+  if (query->source == NULL) {
+    query_dealloc(query);
+    return NULL;
+  }
 
   uint32_t error_offset;
   TSQueryError error_type;
@@ -881,6 +5530,11 @@ static PyObject *query_new_internal(
     const char *capture_name = ts_query_capture_name_for_id(query->query, i, &length);
     PyList_SetItem(query->capture_names, i, PyUnicode_FromStringAndSize(capture_name, length));
   }
+
+  if (query_compile_predicates(query) < 0) {
+    query_dealloc(query);
+    return NULL;
+  }
   return (PyObject *)query;
 }
 
@@ -919,7 +5573,108 @@ static PyObject *language_query(PyObject *self, PyObject *args) {
   return query_new_internal(language, source, length);
 }
 
+static PyObject *tree_language_id(PyObject *self, PyObject *args) {
+  Tree *tree;
+  if (!PyArg_ParseTuple(args, "O!", &tree_type, &tree)) {
+    return NULL;
+  }
+  if (!tree_check_open((PyObject *)tree)) return NULL;
+  return PyLong_FromVoidPtr((void *)ts_tree_language(tree->tree));
+}
+
+static PyObject *query_language_id(PyObject *self, PyObject *args) {
+  Query *query;
+  if (!PyArg_ParseTuple(args, "O!", &query_type, &query)) {
+    return NULL;
+  }
+  return PyLong_FromVoidPtr((void *)query->language);
+}
+
+// The point of a byte offset, found by counting the lines before it.
+static TSPoint source_point_for_offset(const char *source, size_t offset) {
+  TSPoint point = {0, 0};
+  const char *line = source, *end = source + offset, *newline;
+  while ((newline = memchr(line, '\n', end - line)) != NULL) {
+    point.row++;
+    line = newline + 1;
+  }
+  point.column = (uint32_t)(end - line);
+  return point;
+}
+
+// Find the smallest single edit that turns one source into another, by
+// trimming their common prefix and suffix. Returns the arguments to pass to
+// `Tree.edit`, or None if the sources are the same.
+static PyObject *source_edit(PyObject *self, PyObject *args) {
+  Py_buffer old_source, new_source;
+  if (!PyArg_ParseTuple(args, "y*y*", &old_source, &new_source)) return NULL;
+
+  const char *old_bytes = old_source.buf, *new_bytes = new_source.buf;
+  size_t old_length = old_source.len, new_length = new_source.len;
+  size_t shorter = old_length < new_length ? old_length : new_length;
+  size_t prefix = 0, suffix = 0;
+  PyObject *result = NULL;
+  if (old_length > UINT32_MAX || new_length > UINT32_MAX) {
+    PyErr_SetString(PyExc_ValueError, "Sources must be smaller than 4GiB");
+    goto exit;
+  }
+
+  while (prefix < shorter && old_bytes[prefix] == new_bytes[prefix]) prefix++;
+  if (prefix == old_length && prefix == new_length) {
+    Py_INCREF(Py_None);
+    result = Py_None;
+    goto exit;
+  }
+  while (
+    suffix < shorter - prefix &&
+    old_bytes[old_length - suffix - 1] == new_bytes[new_length - suffix - 1]
+  ) suffix++;
+
+  TSPoint start_point = source_point_for_offset(old_bytes, prefix);
+  TSPoint old_end_point = source_point_for_offset(old_bytes, old_length - suffix);
+  TSPoint new_end_point = source_point_for_offset(new_bytes, new_length - suffix);
+  PyObject *points[3] = {
+    point_new(start_point),
+    point_new(old_end_point),
+    point_new(new_end_point),
+  };
+  if (points[0] && points[1] && points[2]) {
+    result = Py_BuildValue(
+      "(IIIOOO)",
+      (uint32_t)prefix,
+      (uint32_t)(old_length - suffix),
+      (uint32_t)(new_length - suffix),
+      points[0],
+      points[1],
+      points[2]
+    );
+  }
+  for (int i = 0; i < 3; i++) Py_XDECREF(points[i]);
+
+exit:
+  PyBuffer_Release(&old_source);
+  PyBuffer_Release(&new_source);
+  return result;
+}
+
+static PyObject *module_allocated_bytes(PyObject *self, PyObject *args) {
+#ifdef _MSC_VER
+  int64_t result = InterlockedCompareExchange64(&allocated_bytes, 0, 0);
+#else
+  int64_t result = __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+#endif
+  return PyLong_FromLongLong(result);
+}
+
 static PyMethodDef module_methods[] = {
+  {
+    .ml_name = "allocated_bytes",
+    .ml_meth = (PyCFunction)module_allocated_bytes,
+    .ml_flags = METH_NOARGS,
+    .ml_doc = "allocated_bytes()\n--\n\n\
+               Get the number of bytes currently allocated by tree-sitter for\n\
+               all parsers, trees and cursors in this process.",
+  },
   {
     .ml_name = "_language_field_id_for_name",
     .ml_meth = (PyCFunction)language_field_id_for_name,
@@ -932,6 +5687,24 @@ static PyMethodDef module_methods[] = {
     .ml_flags = METH_VARARGS,
     .ml_doc = "(internal)",
   },
+  {
+    .ml_name = "_tree_language_id",
+    .ml_meth = (PyCFunction)tree_language_id,
+    .ml_flags = METH_VARARGS,
+    .ml_doc = "(internal)",
+  },
+  {
+    .ml_name = "_query_language_id",
+    .ml_meth = (PyCFunction)query_language_id,
+    .ml_flags = METH_VARARGS,
+    .ml_doc = "(internal)",
+  },
+  {
+    .ml_name = "_source_edit",
+    .ml_meth = (PyCFunction)source_edit,
+    .ml_flags = METH_VARARGS,
+    .ml_doc = "(internal)",
+  },
   {NULL},
 };
 
@@ -947,6 +5720,17 @@ PyMODINIT_FUNC PyInit_binding(void) {
   PyObject *module = PyModule_Create(&module_definition);
   if (module == NULL) return NULL;
 
+  if (PyStructSequence_InitType2(&point_type, &point_desc) < 0) return NULL;
+  Py_INCREF(&point_type);
+  PyModule_AddObject(module, "Point", (PyObject *)&point_type);
+
+  language_libraries = PyDict_New();
+  if (language_libraries == NULL) return NULL;
+
+  if (PyType_Ready(&language_type) < 0) return NULL;
+  Py_INCREF(&language_type);
+  PyModule_AddObject(module, "Language", (PyObject *)&language_type);
+
   if (PyType_Ready(&parser_type) < 0) return NULL;
   Py_INCREF(&parser_type);
   PyModule_AddObject(module, "Parser", (PyObject *)&parser_type);
@@ -967,5 +5751,25 @@ PyMODINIT_FUNC PyInit_binding(void) {
   Py_INCREF(&query_type);
   PyModule_AddObject(module, "Query", (PyObject *)&query_type);
 
+  if (PyType_Ready(&query_iterator_type) < 0) return NULL;
+
+  if (PyType_Ready(&query_set_type) < 0) return NULL;
+  Py_INCREF(&query_set_type);
+  PyModule_AddObject(module, "QuerySet", (PyObject *)&query_set_type);
+
+  if (PyType_Ready(&node_iterator_type) < 0) return NULL;
+
+  if (PyType_Ready(&node_children_type) < 0) return NULL;
+
+  if (PyType_Ready(&node_children_iterator_type) < 0) return NULL;
+
+  if (PyType_Ready(&capture_arrays_type) < 0) return NULL;
+  Py_INCREF(&capture_arrays_type);
+  PyModule_AddObject(module, "CaptureArrays", (PyObject *)&capture_arrays_type);
+
+  if (PyType_Ready(&range_type) < 0) return NULL;
+  Py_INCREF(&range_type);
+  PyModule_AddObject(module, "Range", (PyObject *)&range_type);
+
   return module;
 }